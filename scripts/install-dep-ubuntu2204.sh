@@ -2,6 +2,6 @@
 
 sudo apt update
 
-sudo apt install build-essential qtdeclarative5-dev qtmultimedia5-dev qml-module-qtquick-window2 qml-module-qtquick-controls2 qml-module-qtquick-dialogs qml-module-qtmultimedia libqt5multimedia5-plugins qtgstreamer-plugins-qt5
+sudo apt install build-essential qtdeclarative5-dev qtmultimedia5-dev qml-module-qtquick-window2 qml-module-qtquick-controls2 qml-module-qtquick-dialogs qml-module-qtmultimedia libqt5multimedia5-plugins qtgstreamer-plugins-qt5 liblz4-dev
 
 sudo apt install ffmpeg git vim
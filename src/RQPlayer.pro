@@ -1,17 +1,27 @@
 QT += quick multimedia
 
-CONFIG += c++11
+CONFIG += c++11 link_pkgconfig
+
+PKGCONFIG += liblz4
 
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+        audiometer.cpp \
         audiooutput.cpp \
+        checksums.cpp \
         filereaders.cpp \
+        framefilters.cpp \
+        framepool.cpp \
         framespresenter.cpp \
         main.cpp \
-        orchestrator.cpp
+        orchestrator.cpp \
+        rqvideoitem.cpp \
+        scopeview.cpp \
+        videoplanes.cpp \
+        videoscopes.cpp
 
 RESOURCES += qml.qrc
 
@@ -27,7 +37,16 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
+    audiometer.h \
     audiooutput.h \
+    checksums.h \
     filereaders.h \
+    framefilters.h \
+    framepool.h \
     framespresenter.h \
-    orchestrator.h
+    orchestrator.h \
+    rqvideoitem.h \
+    rqzformat.h \
+    scopeview.h \
+    videoplanes.h \
+    videoscopes.h
@@ -0,0 +1,483 @@
+/* audiometer.cpp
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "audiometer.h"
+
+#include <QMutexLocker>
+#include <QtMath>
+#include <QDebug>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define METER_FLOOR_DB          -70.0
+#define MAX_PENDING_BUFFERS     64
+#define TRUE_PEAK_PHASES        4
+// PPM type I return: 20 dB in 1.7 s
+#define PPM_DECAY_DB_PER_SEC    (20.0 / 1.7)
+// 100 ms blocks; momentary is 4 of them, short-term 30
+#define MOMENTARY_BLOCKS        4
+#define SHORT_TERM_BLOCKS       30
+// Gating histogram, 0.1 LU bins from -70 to +30 LUFS
+#define GATE_BINS               1000
+#define STATS_INTERVAL_SEC      10.0
+
+namespace RQPlayer {
+
+namespace {
+
+inline double energyToLoudness(double energy)
+{
+    return energy > 0 ? qMax(METER_FLOOR_DB, -0.691 + 10 * std::log10(energy))
+                      : METER_FLOOR_DB;
+}
+
+#ifdef __SSE2__
+static_assert(METER_TRUE_PEAK_TAPS % 4 == 0 && METER_MAX_CHANNELS % 4 == 0
+              && TRUE_PEAK_PHASES == 4,
+              "true-peak taps, phases and channels must fill SSE vectors");
+
+inline __m128 absPs(__m128 v)
+{
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+}
+
+// Largest of the 4 lanes
+inline float maxLane(__m128 v)
+{
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+#endif
+
+inline double amplitudeToDb(double amplitude)
+{
+    return amplitude > 0 ? qMax(METER_FLOOR_DB, 20 * std::log10(amplitude))
+                         : METER_FLOOR_DB;
+}
+
+} // namespace
+
+AudioMeter::AudioMeter(const QAudioFormat &format, QObject *parent)
+    : QThread(parent), m_format(format),
+      m_channels(qMin(format.channelCount(), METER_MAX_CHANNELS)),
+      m_blockFrames(qMax(1, format.sampleRate() / 10)),
+      m_stopRequested(false), m_enabled(false), m_resetRequested(false),
+      m_peakLevels(m_channels, METER_FLOOR_DB),
+      m_momentary(METER_FLOOR_DB), m_shortTerm(METER_FLOOR_DB),
+      m_integrated(METER_FLOOR_DB), m_truePeak(METER_FLOOR_DB)
+{
+    // K-weighting (ITU-R BS.1770) pre-filter and RLB high-pass, derived
+    // for the actual sample rate
+    const double rate = qMax(1, format.sampleRate());
+    double f0 = 1681.974450955533;
+    double gain = 3.999843853973347;
+    double q = 0.7071752369554196;
+    double k = std::tan(M_PI * f0 / rate);
+    const double vh = std::pow(10.0, gain / 20.0);
+    const double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    m_shelf = {float((vh + vb * k / q + k * k) / a0),
+               float(2.0 * (k * k - vh) / a0),
+               float((vh - vb * k / q + k * k) / a0),
+               float(2.0 * (k * k - 1.0) / a0),
+               float((1.0 - k / q + k * k) / a0)};
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = std::tan(M_PI * f0 / rate);
+    a0 = 1.0 + k / q + k * k;
+    m_highPass = {1.0f, -2.0f, 1.0f,
+                  float(2.0 * (k * k - 1.0) / a0),
+                  float((1.0 - k / q + k * k) / a0)};
+
+    // 4x oversampling interpolator for true-peak, Hann windowed sinc
+    // split in polyphase form, each phase normalized to unity gain
+    const int taps = TRUE_PEAK_PHASES * METER_TRUE_PEAK_TAPS;
+    QVector<double> h(taps);
+    for (int i = 0; i < taps; ++i) {
+        const double t = (i - (taps - 1) / 2.0) / TRUE_PEAK_PHASES;
+        const double sinc = qFuzzyIsNull(t) ? 1.0
+                                            : std::sin(M_PI * t) / (M_PI * t);
+        h[i] = sinc * (0.5 - 0.5 * std::cos(2 * M_PI * (i + 0.5) / taps));
+    }
+    m_truePeakCoeffs.resize(taps);
+    for (int p = 0; p < TRUE_PEAK_PHASES; ++p) {
+        double sum = 0;
+        for (int t = 0; t < METER_TRUE_PEAK_TAPS; ++t) {
+            sum += h[p + TRUE_PEAK_PHASES * t];
+        }
+        // Reversed, to line up with the history oldest sample first
+        for (int t = 0; t < METER_TRUE_PEAK_TAPS; ++t) {
+            m_truePeakCoeffs[p * METER_TRUE_PEAK_TAPS
+                             + METER_TRUE_PEAK_TAPS - 1 - t]
+                    = float(h[p + TRUE_PEAK_PHASES * t] / sum);
+        }
+    }
+
+    reset();
+}
+
+AudioMeter::~AudioMeter()
+{
+}
+
+void AudioMeter::stop()
+{
+    m_stopRequested = true;
+    QMutexLocker lock(&m_pendingMutex);
+    m_bufferAvailable.wakeAll();
+}
+
+void AudioMeter::setEnabled(bool enabled)
+{
+    if (m_enabled != enabled) {
+        if (enabled) {
+            m_resetRequested = true;
+        }
+        m_enabled = enabled;
+        emit enabledChanged(enabled);
+    }
+}
+
+QVariantList AudioMeter::peakLevels() const
+{
+    QMutexLocker lock(&m_levelsMutex);
+    QVariantList levels;
+    for (qreal level : m_peakLevels) {
+        levels.append(level);
+    }
+    return levels;
+}
+
+qreal AudioMeter::momentaryLoudness() const
+{
+    QMutexLocker lock(&m_levelsMutex);
+    return m_momentary;
+}
+
+qreal AudioMeter::shortTermLoudness() const
+{
+    QMutexLocker lock(&m_levelsMutex);
+    return m_shortTerm;
+}
+
+qreal AudioMeter::integratedLoudness() const
+{
+    QMutexLocker lock(&m_levelsMutex);
+    return m_integrated;
+}
+
+qreal AudioMeter::truePeak() const
+{
+    QMutexLocker lock(&m_levelsMutex);
+    return m_truePeak;
+}
+
+void AudioMeter::meterAudio(const QAudioBuffer &abuf)
+{
+    if (!m_enabled || !abuf.isValid()) {
+        return;
+    }
+    QMutexLocker lock(&m_pendingMutex);
+    if (m_pending.size() >= MAX_PENDING_BUFFERS) {
+        if (++m_droppedBuffers % 100 == 1) {
+            qDebug() << "AudioMeter: dropped buffers:" << m_droppedBuffers;
+        }
+        return;
+    }
+    m_pending.enqueue(abuf);
+    m_bufferAvailable.wakeOne();
+}
+
+void AudioMeter::run()
+{
+    if (m_format.sampleSize() != 16
+            || m_format.sampleType() != QAudioFormat::SignedInt
+            || m_format.byteOrder() != QAudioFormat::LittleEndian) {
+        qDebug() << "AudioMeter: Unsupported format:" << m_format;
+        return;
+    }
+    while (!m_stopRequested) {
+        QAudioBuffer abuf;
+        {
+            QMutexLocker lock(&m_pendingMutex);
+            while (m_pending.isEmpty() && !m_stopRequested) {
+                m_bufferAvailable.wait(&m_pendingMutex);
+            }
+            if (m_stopRequested) {
+                break;
+            }
+            abuf = m_pending.dequeue();
+        }
+        if (m_resetRequested.testAndSetRelaxed(true, false)) {
+            reset();
+        }
+        process(abuf);
+    }
+}
+
+void AudioMeter::reset()
+{
+    std::memset(m_shelfZ1, 0, sizeof(m_shelfZ1));
+    std::memset(m_shelfZ2, 0, sizeof(m_shelfZ2));
+    std::memset(m_highPassZ1, 0, sizeof(m_highPassZ1));
+    std::memset(m_highPassZ2, 0, sizeof(m_highPassZ2));
+    std::memset(m_blockSum, 0, sizeof(m_blockSum));
+    std::memset(m_truePeakHistory, 0, sizeof(m_truePeakHistory));
+    m_blockPos = 0;
+    m_blockEnergies.fill(0, SHORT_TERM_BLOCKS);
+    m_blockCount = 0;
+    m_gateCounts.fill(0, GATE_BINS);
+    m_gateEnergies.fill(0, GATE_BINS);
+    m_truePeakPos = 0;
+    m_statsSec = 0;
+
+    QMutexLocker lock(&m_levelsMutex);
+    m_peakLevels.fill(METER_FLOOR_DB, m_channels);
+    m_momentary = m_shortTerm = m_integrated = m_truePeak = METER_FLOOR_DB;
+}
+
+void AudioMeter::process(const QAudioBuffer &abuf)
+{
+    const int channels = m_channels;
+    // Channels padded to whole SSE vectors, the padding is always silent
+    const int paddedChannels = (channels + 3) & ~3;
+    const int stride = m_format.channelCount();
+    const int frames = abuf.frameCount();
+    const qint16 *samples = abuf.constData<qint16>();
+    const Biquad s = m_shelf;
+    const Biquad hp = m_highPass;
+    const float *coeffs = m_truePeakCoeffs.constData();
+    const int taps = METER_TRUE_PEAK_TAPS;
+
+    std::memset(m_bufferPeak, 0, sizeof(m_bufferPeak));
+    std::memset(m_bufferTruePeak, 0, sizeof(m_bufferTruePeak));
+
+#ifdef __SSE2__
+    const __m128 sb0 = _mm_set1_ps(s.b0), sb1 = _mm_set1_ps(s.b1);
+    const __m128 sb2 = _mm_set1_ps(s.b2), sa1 = _mm_set1_ps(s.a1);
+    const __m128 sa2 = _mm_set1_ps(s.a2);
+    const __m128 hb0 = _mm_set1_ps(hp.b0), hb1 = _mm_set1_ps(hp.b1);
+    const __m128 hb2 = _mm_set1_ps(hp.b2), ha1 = _mm_set1_ps(hp.a1);
+    const __m128 ha2 = _mm_set1_ps(hp.a2);
+#endif
+    float x[METER_MAX_CHANNELS] = {};
+    for (int i = 0; i < frames; ++i) {
+        const qint16 *frame = samples + i * stride;
+        for (int c = 0; c < channels; ++c) {
+            x[c] = frame[c] * (1.0f / 32768.0f);
+        }
+
+        // Peak and K-weighting (transposed direct form II biquads),
+        // 4 channels per vector
+#ifdef __SSE2__
+        for (int c = 0; c < paddedChannels; c += 4) {
+            const __m128 xv = _mm_loadu_ps(x + c);
+            _mm_storeu_ps(m_bufferPeak + c,
+                          _mm_max_ps(_mm_loadu_ps(m_bufferPeak + c),
+                                     absPs(xv)));
+
+            __m128 z1 = _mm_loadu_ps(m_shelfZ1 + c);
+            __m128 z2 = _mm_loadu_ps(m_shelfZ2 + c);
+            const __m128 y = _mm_add_ps(_mm_mul_ps(sb0, xv), z1);
+            z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(sb1, xv),
+                                       _mm_mul_ps(sa1, y)), z2);
+            z2 = _mm_sub_ps(_mm_mul_ps(sb2, xv), _mm_mul_ps(sa2, y));
+            _mm_storeu_ps(m_shelfZ1 + c, z1);
+            _mm_storeu_ps(m_shelfZ2 + c, z2);
+
+            z1 = _mm_loadu_ps(m_highPassZ1 + c);
+            z2 = _mm_loadu_ps(m_highPassZ2 + c);
+            const __m128 o = _mm_add_ps(_mm_mul_ps(hb0, y), z1);
+            z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(hb1, y),
+                                       _mm_mul_ps(ha1, o)), z2);
+            z2 = _mm_sub_ps(_mm_mul_ps(hb2, y), _mm_mul_ps(ha2, o));
+            _mm_storeu_ps(m_highPassZ1 + c, z1);
+            _mm_storeu_ps(m_highPassZ2 + c, z2);
+            _mm_storeu_ps(m_blockSum + c,
+                          _mm_add_ps(_mm_loadu_ps(m_blockSum + c),
+                                     _mm_mul_ps(o, o)));
+        }
+#else
+        for (int c = 0; c < paddedChannels; ++c) {
+            m_bufferPeak[c] = qMax(m_bufferPeak[c], std::fabs(x[c]));
+            const float y = s.b0 * x[c] + m_shelfZ1[c];
+            m_shelfZ1[c] = s.b1 * x[c] - s.a1 * y + m_shelfZ2[c];
+            m_shelfZ2[c] = s.b2 * x[c] - s.a2 * y;
+            const float o = hp.b0 * y + m_highPassZ1[c];
+            m_highPassZ1[c] = hp.b1 * y - hp.a1 * o + m_highPassZ2[c];
+            m_highPassZ2[c] = hp.b2 * y - hp.a2 * o;
+            m_blockSum[c] += o * o;
+        }
+#endif
+
+        // True-peak: 4x polyphase interpolation, each phase a dot product
+        // of the coefficients with the last taps samples of the channel
+        const int pos = m_truePeakPos;
+        m_truePeakPos = (m_truePeakPos + 1) % taps;
+        for (int c = 0; c < channels; ++c) {
+            float *hist = m_truePeakHistory[c];
+            hist[pos] = hist[pos + taps] = x[c];
+            const float *window = hist + m_truePeakPos;
+#ifdef __SSE2__
+            __m128 acc[TRUE_PEAK_PHASES];
+            for (int p = 0; p < TRUE_PEAK_PHASES; ++p) {
+                const float *h = coeffs + p * taps;
+                acc[p] = _mm_setzero_ps();
+                for (int t = 0; t < taps; t += 4) {
+                    acc[p] = _mm_add_ps(acc[p],
+                                        _mm_mul_ps(_mm_loadu_ps(window + t),
+                                                   _mm_loadu_ps(h + t)));
+                }
+            }
+            // Transposed and summed, lane p holds the output of phase p
+            _MM_TRANSPOSE4_PS(acc[0], acc[1], acc[2], acc[3]);
+            const __m128 out = _mm_add_ps(_mm_add_ps(acc[0], acc[1]),
+                                          _mm_add_ps(acc[2], acc[3]));
+            m_bufferTruePeak[c] = qMax(m_bufferTruePeak[c],
+                                       maxLane(absPs(out)));
+#else
+            for (int p = 0; p < TRUE_PEAK_PHASES; ++p) {
+                const float *h = coeffs + p * taps;
+                float acc = 0;
+                for (int t = 0; t < taps; ++t) {
+                    acc += window[t] * h[t];
+                }
+                m_bufferTruePeak[c] = qMax(m_bufferTruePeak[c],
+                                           std::fabs(acc));
+            }
+#endif
+        }
+
+        if (++m_blockPos == m_blockFrames) {
+            finishBlock();
+        }
+    }
+
+    publish(double(frames) / m_format.sampleRate());
+}
+
+void AudioMeter::finishBlock()
+{
+    // Channel weights are all 1.0: the channel layout isn't known
+    double energy = 0;
+    for (int c = 0; c < m_channels; ++c) {
+        energy += double(m_blockSum[c]) / m_blockFrames;
+        m_blockSum[c] = 0;
+    }
+    m_blockPos = 0;
+    m_blockEnergies[m_blockCount % SHORT_TERM_BLOCKS] = energy;
+    ++m_blockCount;
+
+    // Gating blocks are the 400 ms momentary windows, 75% overlapped
+    if (m_blockCount >= MOMENTARY_BLOCKS) {
+        double gatingEnergy = 0;
+        for (int i = 1; i <= MOMENTARY_BLOCKS; ++i) {
+            gatingEnergy += m_blockEnergies[
+                    (m_blockCount - i) % SHORT_TERM_BLOCKS];
+        }
+        gatingEnergy /= MOMENTARY_BLOCKS;
+        const double loudness = energyToLoudness(gatingEnergy);
+        if (loudness > METER_FLOOR_DB) {
+            const int bin = qBound(0, int((loudness - METER_FLOOR_DB) * 10),
+                                   GATE_BINS - 1);
+            ++m_gateCounts[bin];
+            m_gateEnergies[bin] += gatingEnergy;
+        }
+    }
+}
+
+void AudioMeter::publish(double elapsedSec)
+{
+    auto windowEnergy = [this](int blocks) {
+        blocks = qMin(blocks, m_blockCount);
+        double energy = 0;
+        for (int i = 1; i <= blocks; ++i) {
+            energy += m_blockEnergies[(m_blockCount - i) % SHORT_TERM_BLOCKS];
+        }
+        return blocks ? energy / blocks : 0.0;
+    };
+    const double momentary = energyToLoudness(
+                windowEnergy(MOMENTARY_BLOCKS));
+    const double shortTerm = energyToLoudness(
+                windowEnergy(SHORT_TERM_BLOCKS));
+
+    // Integrated: absolute gate at -70 LUFS (blocks below it are never
+    // added), then relative gate 10 LU below the absolutely gated level
+    quint64 count = 0;
+    double energy = 0;
+    for (int i = 0; i < GATE_BINS; ++i) {
+        count += m_gateCounts[i];
+        energy += m_gateEnergies[i];
+    }
+    double integrated = METER_FLOOR_DB;
+    if (count) {
+        const double relativeGate = energyToLoudness(energy / count) - 10;
+        const int firstBin = qMax(0, int(std::ceil(
+                                      (relativeGate - METER_FLOOR_DB) * 10)));
+        count = 0;
+        energy = 0;
+        for (int i = firstBin; i < GATE_BINS; ++i) {
+            count += m_gateCounts[i];
+            energy += m_gateEnergies[i];
+        }
+        if (count) {
+            integrated = energyToLoudness(energy / count);
+        }
+    }
+
+    float bufferTruePeak = 0;
+    for (int c = 0; c < m_channels; ++c) {
+        bufferTruePeak = qMax(bufferTruePeak, m_bufferTruePeak[c]);
+    }
+
+    {
+        QMutexLocker lock(&m_levelsMutex);
+        const double decay = PPM_DECAY_DB_PER_SEC * elapsedSec;
+        for (int c = 0; c < m_channels; ++c) {
+            m_peakLevels[c] = qMax(amplitudeToDb(m_bufferPeak[c]),
+                                   qMax(METER_FLOOR_DB,
+                                        m_peakLevels[c] - decay));
+        }
+        m_momentary = momentary;
+        m_shortTerm = shortTerm;
+        m_integrated = integrated;
+        m_truePeak = qMax(m_truePeak, amplitudeToDb(bufferTruePeak));
+    }
+
+    m_statsSec += elapsedSec;
+    if (m_statsSec >= STATS_INTERVAL_SEC) {
+        m_statsSec = 0;
+        qDebug().nospace() << "AudioMeter: M " << momentary
+                           << " S " << shortTerm
+                           << " I " << integrated << " LUFS, TP max "
+                           << truePeak() << " dBTP";
+    }
+
+    // Property notifications must be delivered on the GUI thread
+    QMetaObject::invokeMethod(this, [this]() { emit levelsChanged(); },
+                              Qt::QueuedConnection);
+}
+
+} // namespace RQPlayer
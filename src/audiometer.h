@@ -0,0 +1,142 @@
+/* audiometer.h
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RQPLAYER_AUDIOMETER_H
+#define RQPLAYER_AUDIOMETER_H
+
+#include <QThread>
+#include <QAudioBuffer>
+#include <QQueue>
+#include <QVector>
+#include <QVariantList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInteger>
+
+#define METER_MAX_CHANNELS      16
+#define METER_TRUE_PEAK_TAPS    12
+
+namespace RQPlayer {
+
+// Peak programme, EBU R128 loudness and true-peak metering of the audio
+// being played. Buffers are handed over to the metering thread without
+// blocking the caller; they are dropped if the metering falls behind.
+class AudioMeter : public QThread
+{
+    Q_OBJECT
+
+    Q_PROPERTY(bool enabled
+               READ isEnabled
+               WRITE setEnabled
+               NOTIFY enabledChanged)
+    Q_PROPERTY(int channelCount READ channelCount CONSTANT)
+    Q_PROPERTY(QVariantList peakLevels READ peakLevels NOTIFY levelsChanged)
+    Q_PROPERTY(qreal momentaryLoudness
+               READ momentaryLoudness NOTIFY levelsChanged)
+    Q_PROPERTY(qreal shortTermLoudness
+               READ shortTermLoudness NOTIFY levelsChanged)
+    Q_PROPERTY(qreal integratedLoudness
+               READ integratedLoudness NOTIFY levelsChanged)
+    Q_PROPERTY(qreal truePeak READ truePeak NOTIFY levelsChanged)
+
+public:
+    explicit AudioMeter(const QAudioFormat &format,
+                        QObject *parent = nullptr);
+    ~AudioMeter();
+
+    void stop();
+
+    bool isEnabled() const { return m_enabled; }
+    void setEnabled(bool enabled);
+
+    // Channels metered, the length of peakLevels
+    int channelCount() const { return m_channels; }
+    // dBFS per channel, with PPM style decay
+    QVariantList peakLevels() const;
+    // LUFS
+    qreal momentaryLoudness() const;
+    qreal shortTermLoudness() const;
+    qreal integratedLoudness() const;
+    // Maximum true-peak so far, dBTP
+    qreal truePeak() const;
+
+public slots:
+    void meterAudio(const QAudioBuffer &abuf);
+
+signals:
+    void enabledChanged(bool enabled);
+    void levelsChanged();
+
+protected:
+    void run() override;
+
+private:
+    struct Biquad {
+        float b0, b1, b2, a1, a2;
+    };
+
+    void process(const QAudioBuffer &abuf);
+    void finishBlock();
+    void publish(double elapsedSec);
+    void reset();
+
+    QAudioFormat m_format;
+    int m_channels;
+    int m_blockFrames;
+
+    QAtomicInteger<bool> m_stopRequested;
+    QAtomicInteger<bool> m_enabled;
+    QAtomicInteger<bool> m_resetRequested;
+
+    QQueue<QAudioBuffer> m_pending;
+    quint64 m_droppedBuffers = 0;
+    QMutex m_pendingMutex;
+    QWaitCondition m_bufferAvailable;
+
+    // Metering state, only touched by the metering thread. Per channel
+    // arrays are padded so the filters run on 4 channels at a time.
+    Biquad m_shelf, m_highPass;
+    float m_shelfZ1[METER_MAX_CHANNELS], m_shelfZ2[METER_MAX_CHANNELS];
+    float m_highPassZ1[METER_MAX_CHANNELS], m_highPassZ2[METER_MAX_CHANNELS];
+    float m_blockSum[METER_MAX_CHANNELS];
+    int m_blockPos;
+    QVector<double> m_blockEnergies;    // last 3 s of 100 ms blocks
+    int m_blockCount;
+    QVector<quint32> m_gateCounts;      // gating block histogram
+    QVector<double> m_gateEnergies;
+
+    QVector<float> m_truePeakCoeffs;    // phases x taps, oldest tap first
+    // Per channel history, written twice so that the last taps samples
+    // are always contiguous at m_truePeakPos
+    float m_truePeakHistory[METER_MAX_CHANNELS][2 * METER_TRUE_PEAK_TAPS];
+    int m_truePeakPos;
+    float m_bufferPeak[METER_MAX_CHANNELS];
+    float m_bufferTruePeak[METER_MAX_CHANNELS];
+    double m_statsSec;
+
+    // Published values
+    mutable QMutex m_levelsMutex;
+    QVector<qreal> m_peakLevels;
+    qreal m_momentary, m_shortTerm, m_integrated, m_truePeak;
+};
+
+} // namespace RQPlayer
+
+#endif // RQPLAYER_AUDIOMETER_H
@@ -21,6 +21,8 @@
 #include "audiooutput.h"
 
 #include <QAudioOutput>
+#include <QElapsedTimer>
+#include <QDebug>
 
 namespace RQPlayer {
 
@@ -28,13 +30,35 @@ AudioOutput::AudioOutput(const QAudioFormat &audioFormat,
                          QObject *parent)
     : QObject(parent), m_audioFormat(audioFormat)
 {
+}
+
+void AudioOutput::open()
+{
+    if (m_audioOutput) {
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
     m_audioOutput = new QAudioOutput(m_audioFormat, this);
     m_audioStream = m_audioOutput->start();
+    qDebug() << "AudioOutput: device opened in" << timer.elapsed() << "ms";
+}
+
+void AudioOutput::close()
+{
+    if (m_audioOutput) {
+        m_audioOutput->stop();
+        delete m_audioOutput;
+        m_audioOutput = nullptr;
+        m_audioStream = nullptr;
+    }
 }
 
 void AudioOutput::playAudio(const QAudioBuffer &buf)
 {
-    m_audioStream->write(buf.constData<char>(), buf.byteCount());
+    if (m_audioStream) {
+        m_audioStream->write(buf.constData<char>(), buf.byteCount());
+    }
 }
 
 } // namespace RQPlayer
@@ -39,12 +39,17 @@ public:
                          QObject *parent = nullptr);
 
 public slots:
+    // Opens / closes the audio device, called on the thread that
+    // AudioOutput lives in
+    void open();
+    void close();
+
     void playAudio(const QAudioBuffer &buf);
 
 private:
     QAudioFormat m_audioFormat;
-    QAudioOutput *m_audioOutput;
-    QIODevice *m_audioStream;
+    QAudioOutput *m_audioOutput = nullptr;
+    QIODevice *m_audioStream = nullptr;
 };
 
 } // namespace RQPlayer
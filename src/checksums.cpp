@@ -0,0 +1,309 @@
+/* checksums.cpp
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "checksums.h"
+
+#include <QMutexLocker>
+#include <QDebug>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define HAVE_CRC32C_SSE42
+#endif
+
+// How far ahead in the reference to look for a frame before calling it
+// a mismatch rather than a run of missing frames
+#define RESYNC_WINDOW   250
+
+// Reference lines with frame indexes past this (about 77 hours at 60 fps),
+// or more than RESYNC_WINDOW beyond the frames read so far, are rejected
+#define MAX_REFERENCE_FRAMES    (1 << 24)
+
+namespace RQPlayer {
+
+namespace {
+
+const char *streamNames[] = {"video", "audio"};
+const char streamTags[] = {'v', 'a'};
+
+// Slicing-by-8 tables for the reflected Castagnoli polynomial
+struct Crc32cTables {
+    quint32 table[8][256];
+
+    Crc32cTables()
+    {
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 crc = i;
+            for (int j = 0; j < 8; ++j) {
+                crc = (crc >> 1) ^ (crc & 1 ? 0x82F63B78 : 0);
+            }
+            table[0][i] = crc;
+        }
+        for (quint32 i = 0; i < 256; ++i) {
+            for (int t = 1; t < 8; ++t) {
+                table[t][i] = (table[t - 1][i] >> 8)
+                        ^ table[0][table[t - 1][i] & 0xFF];
+            }
+        }
+    }
+};
+
+quint32 crc32cSoftware(const uchar *p, size_t size, quint32 crc)
+{
+    static const Crc32cTables tables;
+    const auto &t = tables.table;
+    while (size >= 8) {
+        quint32 lo, hi;
+        std::memcpy(&lo, p, 4);
+        std::memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF]
+                ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+                ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF]
+                ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        p += 8;
+        size -= 8;
+    }
+    while (size--) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef HAVE_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+quint32 crc32cHardware(const uchar *p, size_t size, quint32 crc)
+{
+    quint64 crc64 = crc;
+    while (size >= 8) {
+        quint64 v;
+        std::memcpy(&v, p, 8);
+        crc64 = _mm_crc32_u64(crc64, v);
+        p += 8;
+        size -= 8;
+    }
+    crc = quint32(crc64);
+    while (size--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+} // namespace
+
+quint32 crc32c(const void *data, size_t size, quint32 crc)
+{
+    const uchar *p = static_cast<const uchar *>(data);
+    crc = ~crc;
+    // Little-endian only, like the rest of the player (see slicing-by-8)
+#ifdef HAVE_CRC32C_SSE42
+    static const bool hasSse42 = __builtin_cpu_supports("sse4.2");
+    if (hasSse42) {
+        return ~crc32cHardware(p, size, crc);
+    }
+#endif
+    return ~crc32cSoftware(p, size, crc);
+}
+
+bool crc32cSelfTest()
+{
+    // Check value of the CRC-32C catalogue entry
+    static const char check[] = "123456789";
+    const quint32 expected = 0xE3069283;
+    const uchar *p = reinterpret_cast<const uchar *>(check);
+    bool ok = true;
+    if (~crc32cSoftware(p, 9, ~0u) != expected) {
+        qDebug() << "crc32c: slicing-by-8 self test failed";
+        ok = false;
+    }
+#ifdef HAVE_CRC32C_SSE42
+    if (__builtin_cpu_supports("sse4.2")
+            && ~crc32cHardware(p, 9, ~0u) != expected) {
+        qDebug() << "crc32c: SSE4.2 self test failed";
+        ok = false;
+    }
+#endif
+    return ok;
+}
+
+
+ChecksumVerifier::ChecksumVerifier()
+{
+}
+
+ChecksumVerifier::~ChecksumVerifier()
+{
+    finish();
+}
+
+bool ChecksumVerifier::openLog(const QString &fileName)
+{
+    QMutexLocker lock(&m_mutex);
+    m_log.setFileName(fileName);
+    if (!m_log.open(QFile::WriteOnly | QFile::Truncate)) {
+        qDebug() << "ChecksumVerifier: Failed to open log file:" << fileName;
+        return false;
+    }
+    return true;
+}
+
+bool ChecksumVerifier::loadReference(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        qDebug() << "ChecksumVerifier: Failed to open reference file:"
+                 << fileName;
+        return false;
+    }
+    QMutexLocker lock(&m_mutex);
+    while (!file.atEnd()) {
+        const QByteArray line = file.readLine().simplified();
+        const QList<QByteArray> fields = line.split(' ');
+        if (fields.size() < 3 || fields[0].size() != 1) {
+            continue;
+        }
+        const int stream = fields[0][0] == streamTags[Video] ? Video
+                : fields[0][0] == streamTags[Audio] ? Audio : -1;
+        bool ok = false;
+        const quint64 index = fields[1].toULongLong(&ok);
+        if (stream < 0 || !ok) {
+            continue;
+        }
+        QVector<quint32> crcs;
+        for (int i = 2; i < fields.size(); ++i) {
+            crcs.append(fields[i].toUInt(nullptr, 16));
+        }
+        auto &reference = m_streams[stream].reference;
+        if (index >= MAX_REFERENCE_FRAMES
+                || index > quint64(reference.size()) + RESYNC_WINDOW) {
+            qDebug() << "ChecksumVerifier: Bad frame index in reference:"
+                     << line;
+            continue;
+        }
+        if (index >= quint64(reference.size())) {
+            reference.resize(int(index) + 1);
+        }
+        reference[int(index)] = crcs;
+    }
+    m_hasReference = true;
+    qDebug() << "ChecksumVerifier: reference loaded:"
+             << m_streams[Video].reference.size() << "video and"
+             << m_streams[Audio].reference.size() << "audio frames";
+    return true;
+}
+
+void ChecksumVerifier::addFrame(Stream stream, quint64 index,
+                                const QVector<quint32> &crcs)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_log.isOpen()) {
+        QByteArray line;
+        line.append(streamTags[stream]);
+        line.append(' ');
+        line.append(QByteArray::number(index));
+        for (quint32 crc : crcs) {
+            line.append(' ');
+            line.append(QByteArray::number(crc, 16).rightJustified(8, '0'));
+        }
+        line.append('\n');
+        m_log.write(line);
+    }
+    if (m_hasReference) {
+        verify(stream, index, crcs);
+    }
+}
+
+void ChecksumVerifier::setLoopLength(Stream stream, quint64 frames)
+{
+    QMutexLocker lock(&m_mutex);
+    m_streams[stream].loopLength = frames;
+}
+
+void ChecksumVerifier::verify(Stream stream, quint64 index,
+                              const QVector<quint32> &crcs)
+{
+    StreamState &state = m_streams[stream];
+    const auto &reference = state.reference;
+    if (state.loopLength) {
+        index %= state.loopLength;
+        if (index == 0 && state.checked) {
+            // Next pass, frames missing in the last one don't carry over
+            state.reached = qMax(state.reached, qint64(state.lastIndex) + 1
+                                 + state.offset);
+            state.offset = 0;
+        }
+    }
+    const qint64 refIndex = qint64(index) + state.offset;
+    ++state.checked;
+    state.lastIndex = index;
+
+    if (refIndex < reference.size() && reference[int(refIndex)] == crcs) {
+        return;
+    }
+    // Frames dropped in between show up as a match further ahead
+    for (qint64 k = 1; k <= RESYNC_WINDOW
+         && refIndex + k < reference.size(); ++k) {
+        if (reference[int(refIndex + k)] == crcs) {
+            qDebug() << "ChecksumVerifier:" << streamNames[stream]
+                     << "reference frames" << refIndex << "to"
+                     << refIndex + k - 1 << "missing";
+            state.offset += k;
+            state.missing += k;
+            return;
+        }
+    }
+    ++state.mismatches;
+    if (refIndex >= reference.size()) {
+        qDebug() << "ChecksumVerifier:" << streamNames[stream] << "frame"
+                 << index << "is beyond the end of the reference";
+    }
+    else {
+        qDebug() << "ChecksumVerifier:" << streamNames[stream] << "frame"
+                 << index << "mismatch (reference frame" << refIndex << ")";
+    }
+}
+
+void ChecksumVerifier::finish()
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_finished) {
+        return;
+    }
+    m_finished = true;
+    if (m_log.isOpen()) {
+        m_log.close();
+    }
+    if (!m_hasReference) {
+        return;
+    }
+    for (int stream = Video; stream <= Audio; ++stream) {
+        const StreamState &state = m_streams[stream];
+        const qint64 reached = qMax(state.reached, state.checked
+                ? qint64(state.lastIndex) + 1 + state.offset : 0);
+        qDebug() << "ChecksumVerifier:" << streamNames[stream] << "checked:"
+                 << state.checked << "mismatches:" << state.mismatches
+                 << "missing:" << state.missing << "not reached:"
+                 << qMax(qint64(0), state.reference.size() - reached);
+    }
+}
+
+} // namespace RQPlayer
@@ -0,0 +1,90 @@
+/* checksums.h
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RQPLAYER_CHECKSUMS_H
+#define RQPLAYER_CHECKSUMS_H
+
+#include <QString>
+#include <QVector>
+#include <QFile>
+#include <QMutex>
+
+#include <cstddef>
+
+namespace RQPlayer {
+
+// CRC32C (Castagnoli), using the SSE4.2 crc32 instruction when the CPU
+// has it. Pass the previous result as crc to continue a checksum.
+quint32 crc32c(const void *data, size_t size, quint32 crc = 0);
+
+// Known-answer test of both the SSE4.2 and the table driven paths
+bool crc32cSelfTest();
+
+// Logs per frame checksums (one CRC32C per plane / audio chunk) and / or
+// verifies them against a reference log written by an earlier run.
+//
+// Log format, one line per frame:  <v|a> <index> <crc hex>...
+class ChecksumVerifier
+{
+public:
+    enum Stream {
+        Video,
+        Audio
+    };
+
+    ChecksumVerifier();
+    ~ChecksumVerifier();
+
+    bool openLog(const QString &fileName);
+    bool loadReference(const QString &fileName);
+
+    // Thread safe, called by the file readers for every frame read
+    void addFrame(Stream stream, quint64 index, const QVector<quint32> &crcs);
+
+    // For looped playback, frames are verified at index modulo frames
+    void setLoopLength(Stream stream, quint64 frames);
+
+    // Logs a summary of the verification
+    void finish();
+
+private:
+    struct StreamState {
+        QVector<QVector<quint32>> reference;
+        qint64 offset = 0;      // frames missing so far
+        quint64 checked = 0;
+        quint64 mismatches = 0;
+        quint64 missing = 0;
+        quint64 lastIndex = 0;
+        quint64 loopLength = 0;
+        qint64 reached = 0;     // reference frames reached in past passes
+    };
+
+    void verify(Stream stream, quint64 index, const QVector<quint32> &crcs);
+
+    QMutex m_mutex;
+    QFile m_log;
+    bool m_hasReference = false;
+    bool m_finished = false;
+    StreamState m_streams[2];
+};
+
+} // namespace RQPlayer
+
+#endif // RQPLAYER_CHECKSUMS_H
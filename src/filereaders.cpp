@@ -21,34 +21,204 @@
 #include "filereaders.h"
 
 #include <QFile>
+#include <QFileInfo>
 #include <QDateTime>
 #include <QDebug>
+#include <QRegularExpression>
+#include <QtEndian>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QMutexLocker>
 #include <cstdio>
+#include <cstring>
+#include <vector>
+#include <limits>
+
+#include <lz4.h>
+
+#include "rqzformat.h"
+#include "videoplanes.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Frame buffers allocated before the input is opened, enough to fill the
+// orchestrator queue plus the frames held by the presenter
+#define FRAME_POOL_PREWARM_COUNT    16
+// Upper bound of RQZ frames decompressed in parallel
+#define MAX_DECOMPRESS_BATCH        8
+// Preloaded audio is kept in a single QByteArray
+#define MAX_AUDIO_PRELOAD_BYTES     (1 << 30)
 
 
 namespace RQPlayer {
 
+namespace {
+
+int createWakeFd()
+{
+#ifdef Q_OS_LINUX
+    return eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#else
+    return -1;
+#endif
+}
+
+void closeWakeFd(int wakeFd)
+{
+#ifdef Q_OS_LINUX
+    if (wakeFd >= 0) {
+        close(wakeFd);
+    }
+#else
+    Q_UNUSED(wakeFd);
+#endif
+}
+
+void signalWakeFd(int wakeFd)
+{
+#ifdef Q_OS_LINUX
+    if (wakeFd >= 0) {
+        eventfd_write(wakeFd, 1);
+    }
+#else
+    Q_UNUSED(wakeFd);
+#endif
+}
+
+// Blocks until fileName exists or wakeFd is signalled. Watches the parent
+// directory with inotify so that a newly created FIFO is picked up at once;
+// falls back to sleeping for a second where inotify isn't usable.
+void waitForFile(const QString &fileName, int wakeFd)
+{
+    const QFileInfo fileInfo(fileName);
+    if (fileInfo.exists()) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    int inotifyFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotifyFd >= 0) {
+        const QByteArray dirPath = QFile::encodeName(fileInfo.absolutePath());
+        if (inotify_add_watch(inotifyFd, dirPath.constData(),
+                              IN_CREATE | IN_MOVED_TO) >= 0) {
+            char events[4096];
+            // Checked again after adding the watch, the file may have
+            // been created in between
+            while (!QFileInfo::exists(fileName)) {
+                pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {wakeFd, POLLIN, 0}};
+                if (poll(fds, 2, -1) < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    break;
+                }
+                if (fds[1].revents & POLLIN) {
+                    break;
+                }
+                while (read(inotifyFd, events, sizeof(events)) > 0) {
+                }
+            }
+            close(inotifyFd);
+            return;
+        }
+        close(inotifyFd);
+    }
+#else
+    Q_UNUSED(wakeFd);
+#endif
+    QThread::sleep(1);
+}
+
+// Best effort, keeps preloaded data from being paged out
+bool lockMemory(const void *data, size_t size)
+{
+#ifdef Q_OS_UNIX
+    return mlock(data, size) == 0;
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    return false;
+#endif
+}
+
+void unlockMemory(const void *data, size_t size)
+{
+#ifdef Q_OS_UNIX
+    munlock(data, size);
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+#endif
+}
+
+// Image sequence file name pattern, a single %d or %0Nd conversion
+// (handled here rather than passed to printf)
+struct SequencePattern {
+    QString prefix;
+    QString suffix;
+    int width = -1;
+
+    bool isValid() const { return width >= 0; }
+
+    QString fileName(qint64 index) const
+    {
+        return prefix + QString::number(index).rightJustified(width, '0')
+                + suffix;
+    }
+
+    static SequencePattern parse(const QString &fileName)
+    {
+        static const QRegularExpression conversion("%(0\\d+)?d");
+        SequencePattern pattern;
+        const auto match = conversion.match(fileName);
+        if (match.hasMatch() && !fileName.mid(match.capturedEnd())
+                .contains('%')) {
+            pattern.prefix = fileName.left(match.capturedStart());
+            pattern.suffix = fileName.mid(match.capturedEnd());
+            pattern.width = match.captured(1).toInt();
+        }
+        return pattern;
+    }
+};
+
+} // namespace
+
 VideoFileReader::VideoFileReader(const QString &fileName,
                                  const QVideoSurfaceFormat &format,
                                  QObject *parent)
     : QThread(parent), m_fileName(fileName), m_format(format),
-      m_stopRequested(false), m_vfp(nullptr)
+      m_stopRequested(false), m_wakeFd(createWakeFd()), m_vfp(nullptr)
 {
 }
 
+VideoFileReader::~VideoFileReader()
+{
+    releasePreloaded();
+    closeWakeFd(m_wakeFd);
+}
+
 void VideoFileReader::stop()
 {
     m_stopRequested = true;
+    signalWakeFd(m_wakeFd);
 
     // Workaround to unblock fopen and fread operations
-    // to gracefully exit file reader thread
+    // to gracefully exit file reader thread. The stream itself is only
+    // closed by run(), on the reader thread.
     QFile f(m_fileName);
     if (f.exists()) {
-        f.open(QFile::WriteOnly);
+        f.open(QFile::WriteOnly | QFile::Append);
         f.close();
-        if (m_vfp) {
-            fclose(m_vfp);
-        }
     }
 }
 
@@ -64,7 +234,27 @@ void VideoFileReader::run()
         return;
     }
     const auto bytesCount = m_format.frameWidth() * m_format.frameHeight() * 2;
+    if (!m_framePool || m_framePool->bufferSize() != bytesCount) {
+        m_framePool = QSharedPointer<FramePool>::create(bytesCount);
+        m_framePool->prewarm(FRAME_POOL_PREWARM_COUNT);
+    }
+    releasePreloaded();
+    m_firstPass = true;
+    {
+        QMutexLocker lock(&m_loopMutex);
+        m_firstPassFrames = 0;
+        m_loopLength = -1;
+    }
+    if (SequencePattern::parse(m_fileName).isValid()) {
+        readSequenceFrames(bytesCount);
+        releasePreloaded();
+        return;
+    }
     while (!m_stopRequested) {
+        waitForFile(m_fileName, m_wakeFd);
+        if (m_stopRequested) {
+            break;
+        }
         qDebug() << "VideoFileReader: Attempting to open file:" << m_fileName;
         m_vfp = fopen(m_fileName.toStdString().c_str(), "r");
         if (m_vfp == nullptr) {
@@ -73,27 +263,537 @@ void VideoFileReader::run()
             continue;
         }
         qDebug() << "VideoFileReader: file opened for reading:" << m_fileName;
-        while (!m_stopRequested) {
-            QVideoFrame frame(bytesCount, m_format.frameSize(),
-                              m_format.frameWidth(), m_format.pixelFormat());
-            frame.map(QAbstractVideoBuffer::WriteOnly);
-            size_t c = fread(frame.bits(), bytesCount, 1, m_vfp);
-            frame.unmap();
-            if (!m_stopRequested && c) {
-                // qDebug() << "VideoFileReader: frameReady";
-                emit frameReady(frame);
+
+        // RQZ (compressed) input is told apart from raw frames by its magic
+        char magic[RQZ_MAGIC_SIZE];
+        if (fread(magic, sizeof(magic), 1, m_vfp) == 1 && !m_stopRequested) {
+            if (std::memcmp(magic, RQZ_MAGIC, RQZ_MAGIC_SIZE) == 0) {
+                qDebug() << "VideoFileReader: reading RQZ frames";
+                readCompressedFrames(bytesCount);
             }
-            else if (feof(m_vfp) || ferror(m_vfp)) {
-                qDebug() << "AudioFileReader: EOF or Error on file:"
-                         << m_fileName;
-                fclose(m_vfp);
+            else {
+                readRawFrames(bytesCount, QByteArray(magic, sizeof(magic)));
+            }
+        }
+        qDebug() << "VideoFileReader: EOF or Error on file:" << m_fileName;
+        fclose(m_vfp);
+        m_vfp = nullptr;
+    }
+    releasePreloaded();
+}
+
+void VideoFileReader::readRawFrames(int bytesCount, const QByteArray &prefix)
+{
+    int prefixSize = prefix.size();
+    while (!m_stopRequested) {
+        QVideoFrame frame = m_framePool->createFrame(
+                    m_format.frameSize(), m_format.frameWidth(),
+                    m_format.pixelFormat());
+        frame.map(QAbstractVideoBuffer::WriteOnly);
+        if (prefixSize) {
+            std::memcpy(frame.bits(), prefix.constData(), prefixSize);
+        }
+        size_t c = fread(frame.bits() + prefixSize, bytesCount - prefixSize,
+                         1, m_vfp);
+        prefixSize = 0;
+        if (c) {
+            checksumFrame(frame);
+        }
+        frame.unmap();
+        if (!m_stopRequested && c) {
+            cacheFrame(frame, ftello(m_vfp));
+            // qDebug() << "VideoFileReader: frameReady";
+            emitFrame(frame);
+        }
+        else if (feof(m_vfp) || ferror(m_vfp)) {
+            if (rewindForLoop(0)) {
+                continue;
+            }
+            break;
+        }
+        else {
+            qDebug() << "VideoFileReader: Failed to read:" << m_fileName;
+        }
+    }
+}
+
+struct DecompressBatch {
+    QVector<QByteArray> blocks;
+    QVector<bool> stored;
+    QVector<bool> ok;
+    QVector<QVideoFrame> frames;
+    QVector<qint64> offsets;    // file offset after each block
+    int count = 0;
+    QSemaphore done;
+
+    void reset(int size)
+    {
+        blocks.resize(size);
+        offsets.resize(size);
+        stored.fill(false, size);
+        ok.fill(false, size);
+        frames.resize(size);
+        count = 0;
+    }
+};
+
+namespace {
+
+// Decompresses one RQZ block straight into its (mapped) pooled frame
+class DecompressTask : public QRunnable
+{
+public:
+    DecompressTask(DecompressBatch &batch, int index, int frameBytes)
+        : m_src(batch.blocks[index].constData()),
+          m_srcSize(batch.blocks[index].size()),
+          m_stored(batch.stored[index]),
+          m_dst(reinterpret_cast<char *>(batch.frames[index].bits())),
+          m_dstSize(frameBytes), m_ok(batch.ok.data() + index),
+          m_done(batch.done)
+    {
+    }
+
+    void run() override
+    {
+        if (m_stored) {
+            *m_ok = m_srcSize == m_dstSize;
+            if (*m_ok) {
+                std::memcpy(m_dst, m_src, m_dstSize);
+            }
+        }
+        else {
+            *m_ok = LZ4_decompress_safe(m_src, m_dst, m_srcSize, m_dstSize)
+                    == m_dstSize;
+        }
+        m_done.release();
+    }
+
+private:
+    const char *m_src;
+    int m_srcSize;
+    bool m_stored;
+    char *m_dst;
+    int m_dstSize;
+    bool *m_ok;
+    QSemaphore &m_done;
+};
+
+} // namespace
+
+void VideoFileReader::readCompressedFrames(int bytesCount)
+{
+    quint32 header[2];  // frame bytes, frame count
+    if (fread(header, sizeof(header), 1, m_vfp) != 1) {
+        return;
+    }
+    if (qFromLittleEndian(header[0]) != quint32(bytesCount)) {
+        qDebug() << "VideoFileReader: RQZ frame size"
+                 << qFromLittleEndian(header[0]) << "doesn't match"
+                 << bytesCount;
+        return;
+    }
+    const quint32 maxBlockSize = quint32(LZ4_compressBound(bytesCount));
+
+    // Frames are read in batches, one batch is decompressed on the pool
+    // while the next one is read
+    const int batchSize = qBound(1, QThread::idealThreadCount(),
+                                 MAX_DECOMPRESS_BATCH);
+    DecompressBatch batches[2];
+    do {
+        DecompressBatch *pending = nullptr;
+        bool atEnd = false;
+        for (int current = 0; !m_stopRequested && !atEnd; current ^= 1) {
+            DecompressBatch &batch = batches[current];
+            batch.reset(batchSize);
+            while (batch.count < batchSize) {
+                quint32 blockSize = 0;
+                if (fread(&blockSize, sizeof(blockSize), 1, m_vfp) != 1
+                        || (blockSize = qFromLittleEndian(blockSize)) == 0) {
+                    atEnd = true;
+                    break;
+                }
+                const int i = batch.count;
+                batch.stored[i] = blockSize & RQZ_STORED_FLAG;
+                blockSize &= ~RQZ_STORED_FLAG;
+                if (blockSize > maxBlockSize) {
+                    qDebug() << "VideoFileReader: corrupt RQZ block size:"
+                             << blockSize;
+                    atEnd = true;
+                    break;
+                }
+                batch.blocks[i].resize(int(blockSize));
+                if (fread(batch.blocks[i].data(), blockSize, 1, m_vfp) != 1) {
+                    atEnd = true;
+                    break;
+                }
+                batch.offsets[i] = ftello(m_vfp);
+                batch.frames[i] = m_framePool->createFrame(
+                            m_format.frameSize(), m_format.frameWidth(),
+                            m_format.pixelFormat());
+                batch.frames[i].map(QAbstractVideoBuffer::WriteOnly);
+                ++batch.count;
+            }
+            for (int i = 0; i < batch.count; ++i) {
+                m_workerPool.start(new DecompressTask(batch, i, bytesCount));
+            }
+
+            if (pending) {
+                finishBatch(*pending);
+            }
+            pending = &batch;
+        }
+        if (pending) {
+            finishBatch(*pending);
+        }
+    } while (rewindForLoop(RQZ_HEADER_SIZE));
+}
+
+namespace {
+
+struct SequenceSlot {
+    QVideoFrame frame;
+    bool ok = false;
+    bool inFlight = false;
+    QSemaphore done;
+};
+
+// Reads one image sequence file into its (mapped) pooled frame
+class SequenceReadTask : public QRunnable
+{
+public:
+    SequenceReadTask(SequenceSlot &slot, const QString &fileName,
+                     int frameBytes)
+        : m_slot(slot), m_fileName(QFile::encodeName(fileName)),
+          m_dst(slot.frame.bits()), m_frameBytes(frameBytes)
+    {
+    }
+
+    void run() override
+    {
+        m_slot.ok = false;
+        FILE *fp = fopen(m_fileName.constData(), "rb");
+        if (fp) {
+            m_slot.ok = fread(m_dst, m_frameBytes, 1, fp) == 1;
+            fclose(fp);
+        }
+        m_slot.done.release();
+    }
+
+private:
+    SequenceSlot &m_slot;
+    QByteArray m_fileName;
+    uchar *m_dst;
+    int m_frameBytes;
+};
+
+} // namespace
+
+void VideoFileReader::readSequenceFrames(int bytesCount)
+{
+    const SequencePattern pattern = SequencePattern::parse(m_fileName);
+    const int depth = m_prefetchDepth;
+    m_workerPool.setMaxThreadCount(QThread::idealThreadCount());
+
+    qint64 start = 0;
+    if (!QFile::exists(pattern.fileName(0))
+            && QFile::exists(pattern.fileName(1))) {
+        start = 1;
+    }
+    qDebug() << "VideoFileReader: reading image sequence from"
+             << pattern.fileName(start) << "prefetch depth:" << depth;
+
+    // Once the end is known, indexes past it wrap around when looping
+    qint64 length = 0;
+    auto fileName = [&](qint64 index) {
+        return pattern.fileName(length > 0
+                                ? start + (index - start) % length : index);
+    };
+
+    // Ring of slots, each one filled by a prefetch task depth frames
+    // ahead of the frame being emitted
+    std::vector<SequenceSlot> ring(depth);
+    auto submit = [&](SequenceSlot &slot, qint64 slotIndex) {
+        slot.inFlight = true;
+        slot.frame = m_framePool->createFrame(m_format.frameSize(),
+                                              m_format.frameWidth(),
+                                              m_format.pixelFormat());
+        slot.frame.map(QAbstractVideoBuffer::WriteOnly);
+        m_workerPool.start(new SequenceReadTask(
+                               slot, fileName(slotIndex), bytesCount));
+    };
+    auto drain = [&]() {
+        for (auto &slot : ring) {
+            if (slot.inFlight) {
+                slot.done.acquire();
+                slot.inFlight = false;
+                slot.frame.unmap();
+                slot.frame = QVideoFrame();
+            }
+        }
+    };
+
+    // With a cached head every pass ends at the last frame, so the head
+    // is replayed from memory at each wrap; without one, reading just
+    // continues across the wrap
+    auto passEnd = [&]() {
+        return length > 0 && !m_preloaded.isEmpty()
+                ? start + length : std::numeric_limits<qint64>::max();
+    };
+
+    QVideoFrame lastFrame;
+    qint64 first = start;
+    for (int i = 0; i < depth; ++i) {
+        submit(ring[(first + i) % depth], first + i);
+    }
+    while (!m_stopRequested) {
+        bool atEnd = false;
+        for (qint64 index = first; !m_stopRequested; ++index) {
+            if (index >= passEnd()) {
+                atEnd = true;
                 break;
             }
+            SequenceSlot &slot = ring[index % depth];
+            slot.done.acquire();
+            slot.inFlight = false;
+            if (slot.ok) {
+                checksumFrame(slot.frame);
+            }
+            slot.frame.unmap();
+            if (slot.ok) {
+                lastFrame = slot.frame;
+                cacheFrame(slot.frame, index + 1);
+            }
             else {
-                qDebug() << "VideoFileReader: Failed to read:" << m_fileName;
+                // The end, unless a later frame already being read ahead
+                // turned out to exist (peeked at without consuming it)
+                atEnd = length == 0;
+                for (int k = 1; atEnd && k < depth; ++k) {
+                    SequenceSlot &next = ring[(index + k) % depth];
+                    next.done.acquire();
+                    atEnd = !next.ok;
+                    next.done.release();
+                }
+                if (atEnd) {
+                    length = index - start;
+                    break;
+                }
+                qDebug() << "VideoFileReader: missing frame:"
+                         << fileName(index);
+            }
+            slot.frame = QVideoFrame();
+            if (lastFrame.isValid() && !m_stopRequested) {
+                // Missing frames repeat the last one to keep A/V sync
+                emitFrame(lastFrame);
             }
+            if (index + depth < passEnd()) {
+                submit(slot, index + depth);
+            }
+        }
+        drain();
+        if (m_firstPass) {
+            qDebug() << "VideoFileReader: end of image sequence";
+        }
+
+        if (!atEnd || !m_loop || length <= 0) {
+            break;
+        }
+        endFirstPass();
+        if (loopPreloaded()) {
+            break;
+        }
+        // Frames after the head are read ahead while it plays from memory
+        first = m_preloaded.isEmpty() ? start : m_preloadResumeOffset;
+        for (int i = 0; i < depth && first + i < passEnd(); ++i) {
+            submit(ring[(first + i) % depth], first + i);
         }
+        replayPreloadedHead();
     }
+    drain();
+}
+
+void VideoFileReader::finishBatch(DecompressBatch &batch)
+{
+    batch.done.acquire(batch.count);
+    for (int i = 0; i < batch.count; ++i) {
+        QVideoFrame &frame = batch.frames[i];
+        if (batch.ok[i]) {
+            checksumFrame(frame);
+        }
+        frame.unmap();
+        if (!batch.ok[i]) {
+            qDebug() << "VideoFileReader: Failed to decompress frame:"
+                     << m_frameIndex;
+        }
+        else if (!m_stopRequested) {
+            cacheFrame(frame, batch.offsets[i]);
+            emitFrame(frame);
+        }
+        frame = QVideoFrame();
+    }
+    batch.count = 0;
+}
+
+void VideoFileReader::checksumFrame(QVideoFrame &frame)
+{
+    if (m_checksumVerifier) {
+        // Checksummed while the frame is still hot in the cache
+        QVector<quint32> crcs(frame.planeCount());
+        for (int p = 0; p < frame.planeCount(); ++p) {
+            crcs[p] = crc32c(frame.bits(p), size_t(planeBytes(frame, p)));
+        }
+        m_checksumVerifier->addFrame(ChecksumVerifier::Video,
+                                     m_frameIndex, crcs);
+        m_lastCrcs = crcs;
+    }
+    ++m_frameIndex;
+}
+
+// Keeps frames of the first pass for looping, nextOffset being where
+// reading continues after frame (file offset, or sequence index)
+void VideoFileReader::cacheFrame(const QVideoFrame &frame, qint64 nextOffset)
+{
+    if (!m_loop || m_preloadLimit <= 0 || !m_firstPass || m_preloadOverflow) {
+        return;
+    }
+    const int frameBytes = m_framePool->bufferSize();
+    if (m_preloadedBytes + frameBytes > m_preloadLimit) {
+        m_preloadOverflow = true;
+        qDebug() << "VideoFileReader: clip exceeds preload limit, keeping"
+                 << m_preloaded.size() << "frames of its head";
+        return;
+    }
+    QVideoFrame locked(frame);
+    if (locked.map(QAbstractVideoBuffer::ReadOnly)) {
+        if (lockMemory(locked.bits(), size_t(frameBytes))) {
+            m_lockedRegions.append(qMakePair(
+                                       static_cast<void *>(locked.bits()),
+                                       size_t(frameBytes)));
+        }
+        else if (m_lockedRegions.size() == m_preloaded.size()) {
+            qDebug() << "VideoFileReader: failed to lock preloaded frames"
+                        " in memory, check RLIMIT_MEMLOCK";
+        }
+        locked.unmap();
+    }
+    m_preloaded.append(frame);
+    m_preloadedCrcs.append(m_lastCrcs);
+    m_preloadedBytes += frameBytes;
+    m_preloadResumeOffset = nextOffset;
+}
+
+void VideoFileReader::releasePreloaded()
+{
+    for (const auto &region : qAsConst(m_lockedRegions)) {
+        unlockMemory(region.first, region.second);
+    }
+    m_lockedRegions.clear();
+    m_preloaded.clear();
+    m_preloadedCrcs.clear();
+    m_preloadedBytes = 0;
+    m_preloadResumeOffset = 0;
+    m_preloadOverflow = false;
+}
+
+// Plays the whole clip from memory until stopped, if it was preloaded
+bool VideoFileReader::loopPreloaded()
+{
+    if (m_preloadLimit <= 0 || m_preloadOverflow || m_preloaded.isEmpty()) {
+        return false;
+    }
+    qDebug() << "VideoFileReader: looping" << m_preloaded.size()
+             << "preloaded frames";
+    while (!m_stopRequested) {
+        replayPreloadedHead();
+    }
+    return true;
+}
+
+// Emits the preloaded frames once, logging the checksums computed when
+// they were read so that frame indexes keep advancing
+void VideoFileReader::replayPreloadedHead()
+{
+    for (int i = 0; i < m_preloaded.size() && !m_stopRequested; ++i) {
+        if (m_checksumVerifier) {
+            m_checksumVerifier->addFrame(ChecksumVerifier::Video,
+                                         m_frameIndex, m_preloadedCrcs[i]);
+        }
+        ++m_frameIndex;
+        emitFrame(m_preloaded[i]);
+    }
+}
+
+// Called at EOF, seeks back to dataOffset (the first frame) when looping.
+// Returns false when reading should stop, or the file be reopened.
+bool VideoFileReader::rewindForLoop(qint64 dataOffset)
+{
+    if (!m_loop || m_stopRequested) {
+        return false;
+    }
+    endFirstPass();
+    if (loopPreloaded()) {
+        return false;
+    }
+    if (fseeko(m_vfp, dataOffset, SEEK_SET) != 0) {
+        qDebug() << "VideoFileReader: input isn't seekable, reopening:"
+                 << m_fileName;
+        return false;
+    }
+    if (!m_preloaded.isEmpty()) {
+        // The head plays from memory while the kernel reads ahead of the
+        // resume point, so the file is never waited on at the wrap
+        fseeko(m_vfp, m_preloadResumeOffset, SEEK_SET);
+#ifdef Q_OS_LINUX
+        posix_fadvise(fileno(m_vfp), m_preloadResumeOffset,
+                      m_preloadResumeOffset - dataOffset,
+                      POSIX_FADV_WILLNEED);
+#endif
+        replayPreloadedHead();
+    }
+    clearerr(m_vfp);
+    return true;
+}
+
+void VideoFileReader::emitFrame(const QVideoFrame &frame)
+{
+    if (m_loop && m_firstPass) {
+        QMutexLocker lock(&m_loopMutex);
+        ++m_firstPassFrames;
+        m_loopProgress.wakeAll();
+    }
+    emit frameReady(frame);
+}
+
+// Publishes the loop length when the first pass of a looped clip ends
+void VideoFileReader::endFirstPass()
+{
+    if (!m_firstPass) {
+        return;
+    }
+    m_firstPass = false;
+    if (m_checksumVerifier) {
+        m_checksumVerifier->setLoopLength(ChecksumVerifier::Video,
+                                          m_frameIndex);
+    }
+    QMutexLocker lock(&m_loopMutex);
+    m_loopLength = m_firstPassFrames;
+    m_loopProgress.wakeAll();
+    qDebug() << "VideoFileReader: loop length:" << m_loopLength << "frames";
+}
+
+qint64 VideoFileReader::loopLength() const
+{
+    QMutexLocker lock(&m_loopMutex);
+    return m_loopLength;
+}
+
+bool VideoFileReader::waitForLoopFrame(qint64 index,
+                                       unsigned long timeoutMsec)
+{
+    QMutexLocker lock(&m_loopMutex);
+    if (m_loopLength < 0 && m_firstPassFrames <= index) {
+        m_loopProgress.wait(&m_loopMutex, timeoutMsec);
+    }
+    return m_loopLength > 0 || m_firstPassFrames > index;
 }
 
 
@@ -103,19 +803,25 @@ AudioFileReader::AudioFileReader(const QString &fileName,
                                  QObject *parent)
     : QThread(parent), m_fileName(fileName), m_format(format),
       m_videoFrameRate(videoFrameRate), m_stopRequested(false),
-      m_afp(nullptr)
+      m_wakeFd(createWakeFd()), m_afp(nullptr)
 {
 }
 
+AudioFileReader::~AudioFileReader()
+{
+    closeWakeFd(m_wakeFd);
+}
+
 void AudioFileReader::stop()
 {
     m_stopRequested = true;
+    signalWakeFd(m_wakeFd);
 
     // Workaround to unblock fopen and fread operations
     // to gracefully exit file reader thread
     QFile f(m_fileName);
     if (f.exists()) {
-        f.open(QFile::WriteOnly);
+        f.open(QFile::WriteOnly | QFile::Append);
         f.close();
         if (m_afp) {
             fclose(m_afp);
@@ -138,7 +844,17 @@ void AudioFileReader::run()
             = m_videoFrameRate > 0 ? 1000.0 /  m_videoFrameRate : 40;
     const auto numAudioFramesPerVideoFrame
             = m_format.framesForDuration(frameDurMsec * 1000);
+    m_firstPass = true;
+    m_playFromMemory = false;
+    m_preloadOverflow = false;
+    m_headPos = -1;
+    m_fileBytes = -1;
+    m_preloaded.clear();
     while (!m_stopRequested) {
+        waitForFile(m_fileName, m_wakeFd);
+        if (m_stopRequested) {
+            break;
+        }
         qDebug() << "AudioFileReader: Attempting to open file:" << m_fileName;
         m_afp = fopen(m_fileName.toStdString().c_str(), "r");
         if (m_afp == nullptr) {
@@ -148,8 +864,46 @@ void AudioFileReader::run()
         }
         qDebug() << "AudioFileReader: file opened for reading:" << m_fileName;
         while (!m_stopRequested) {
+            if (m_loopVideo) {
+                // Buffer i goes with video frame i, so it is only read
+                // once the video has that frame or its loop length
+                bool synced = false;
+                while (!m_stopRequested
+                       && !(synced = m_loopVideo->waitForLoopFrame(
+                                qint64(m_frameIndex), 100))
+                       && !m_loopVideo->isFinished()) {
+                }
+                if (m_stopRequested) {
+                    break;
+                }
+                if (!synced) {
+                    qDebug() << "AudioFileReader: video ended before its loop"
+                                " length was known, looping audio alone";
+                    m_loopVideo = nullptr;
+                }
+            }
             QAudioBuffer abuf(numAudioFramesPerVideoFrame, m_format);
-            size_t c = fread(abuf.data(), abuf.byteCount(), 1, m_afp);
+            const size_t size = size_t(abuf.byteCount());
+            char *data = static_cast<char *>(abuf.data());
+            size_t n;
+            size_t c;
+            if (m_loopVideo) {
+                n = readLoopFrame(data, size);
+                c = !ferror(m_afp);
+            }
+            else {
+                n = readLooped(data, size);
+                c = n == size;
+            }
+            // Buffers padded with silence have no reference to match
+            if (c && n == size && m_checksumVerifier) {
+                m_checksumVerifier->addFrame(
+                            ChecksumVerifier::Audio, m_frameIndex,
+                            {crc32c(abuf.constData(), abuf.byteCount())});
+            }
+            if (c) {
+                ++m_frameIndex;
+            }
             if (!m_stopRequested && c) {
                 // qDebug() << "AudioFileReader: samplesReady";
                 emit samplesReady(abuf);
@@ -165,6 +919,179 @@ void AudioFileReader::run()
             }
         }
     }
+    if (m_preloadLocked) {
+        unlockMemory(m_preloaded.constData(), size_t(m_preloaded.size()));
+        m_preloadLocked = false;
+    }
+}
+
+// Reads size bytes, wrapping around to the start of the file at EOF when
+// looping so that the last buffer of a pass is completed with the first
+// samples of the next one
+size_t AudioFileReader::readLooped(char *dst, size_t size)
+{
+    size_t done = 0;
+    if (m_playFromMemory) {
+        while (done < size) {
+            const size_t n = qMin(size - done,
+                                  size_t(m_preloaded.size() - m_memoryPos));
+            std::memcpy(dst + done, m_preloaded.constData() + m_memoryPos, n);
+            done += n;
+            m_memoryPos = (m_memoryPos + int(n)) % m_preloaded.size();
+        }
+        return done;
+    }
+    if (m_headPos >= 0) {
+        // Head of a clip that didn't fit, right after a wrap
+        const size_t n = qMin(size, size_t(m_preloaded.size() - m_headPos));
+        std::memcpy(dst, m_preloaded.constData() + m_headPos, n);
+        done = n;
+        m_headPos += int(n);
+        if (m_headPos == m_preloaded.size()) {
+            m_headPos = -1;
+        }
+    }
+    bool rewound = false;
+    while (done < size && !m_stopRequested) {
+        const size_t n = fread(dst + done, 1, size - done, m_afp);
+        if (n && m_firstPass && m_preloadLimit > 0 && !m_preloadOverflow) {
+            if (m_preloaded.size() + qint64(n)
+                    > qMin(m_preloadLimit, qint64(MAX_AUDIO_PRELOAD_BYTES))) {
+                m_preloadOverflow = true;
+                qDebug() << "AudioFileReader: clip exceeds preload limit,"
+                            " keeping" << m_preloaded.size()
+                         << "bytes of its head";
+            }
+            else {
+                m_preloaded.append(dst + done, int(n));
+            }
+        }
+        done += n;
+        if (n) {
+            rewound = false;
+        }
+        if (done == size || !m_loop || ferror(m_afp) || !feof(m_afp)
+                || rewound) {
+            break;
+        }
+        m_firstPass = false;
+        if (m_preloadLimit > 0 && !m_preloaded.isEmpty()) {
+            if (!m_preloadLocked) {
+                m_preloadLocked = lockMemory(m_preloaded.constData(),
+                                             size_t(m_preloaded.size()));
+                if (!m_preloadLocked) {
+                    qDebug() << "AudioFileReader: failed to lock preloaded"
+                                " samples in memory, check RLIMIT_MEMLOCK";
+                }
+            }
+            if (!m_preloadOverflow) {
+                qDebug() << "AudioFileReader: looping" << m_preloaded.size()
+                         << "preloaded bytes";
+                m_playFromMemory = true;
+                m_memoryPos = 0;
+                return done + readLooped(dst + done, size - done);
+            }
+            // The head plays from memory while the kernel reads ahead of
+            // the resume point, as VideoFileReader::rewindForLoop() does
+            const qint64 resumeOffset = m_preloaded.size();
+            if (fseeko(m_afp, resumeOffset, SEEK_SET) != 0) {
+                break;
+            }
+#ifdef Q_OS_LINUX
+            posix_fadvise(fileno(m_afp), resumeOffset, resumeOffset,
+                          POSIX_FADV_WILLNEED);
+#endif
+            m_headPos = 0;
+            return done + readLooped(dst + done, size - done);
+        }
+        if (fseeko(m_afp, 0, SEEK_SET) != 0) {
+            break;
+        }
+        rewound = true;
+    }
+    return done;
+}
+
+// Reads buffer m_frameIndex of a loop as long as the video's, from the
+// same position in every pass. Audio past the end of the file reads as
+// silence. Returns the number of bytes that aren't padding.
+size_t AudioFileReader::readLoopFrame(char *dst, size_t size)
+{
+    const qint64 length = m_loopVideo->loopLength();
+    const bool wrapped = length > 0 && qint64(m_frameIndex) >= length;
+    const qint64 pos = qint64(size)
+            * qint64(length > 0 ? m_frameIndex % quint64(length)
+                                : m_frameIndex);
+    if (wrapped && m_firstPass) {
+        m_firstPass = false;
+        qDebug() << "AudioFileReader: looping with the video every"
+                 << length << "frames";
+        if (m_checksumVerifier) {
+            m_checksumVerifier->setLoopLength(ChecksumVerifier::Audio,
+                                              quint64(length));
+        }
+        if (!m_preloaded.isEmpty()) {
+            m_preloadLocked = lockMemory(m_preloaded.constData(),
+                                         size_t(m_preloaded.size()));
+            if (!m_preloadLocked) {
+                qDebug() << "AudioFileReader: failed to lock preloaded"
+                            " samples in memory, check RLIMIT_MEMLOCK";
+            }
+        }
+    }
+
+    size_t done = 0;
+    if (wrapped && pos < m_preloaded.size()) {
+        done = qMin(size, size_t(m_preloaded.size() - pos));
+        std::memcpy(dst, m_preloaded.constData() + pos, done);
+    }
+    if (wrapped && pos == 0 && m_preloadOverflow) {
+        // The head plays from memory while the kernel reads ahead of
+        // the resume point, as VideoFileReader::rewindForLoop() does
+        const qint64 resumeOffset = m_preloaded.size();
+        if (fseeko(m_afp, resumeOffset, SEEK_SET) == 0) {
+#ifdef Q_OS_LINUX
+            posix_fadvise(fileno(m_afp), resumeOffset, resumeOffset,
+                          POSIX_FADV_WILLNEED);
+#endif
+        }
+    }
+    const bool inMemory = wrapped && !m_preloadOverflow && m_preloadLimit > 0;
+    if (done < size && !inMemory
+            && (m_fileBytes < 0 || pos + qint64(done) < m_fileBytes)) {
+        if (ftello(m_afp) != pos + qint64(done)) {
+            fseeko(m_afp, pos + qint64(done), SEEK_SET);
+        }
+        while (done < size && !m_stopRequested) {
+            const size_t n = fread(dst + done, 1, size - done, m_afp);
+            done += n;
+            if (n == 0) {
+                if (feof(m_afp)) {
+                    m_fileBytes = pos + qint64(done);
+                }
+                break;
+            }
+        }
+        if (!wrapped && m_preloadLimit > 0 && !m_preloadOverflow
+                && pos == m_preloaded.size()) {
+            if (m_preloaded.size() + qint64(done)
+                    > qMin(m_preloadLimit, qint64(MAX_AUDIO_PRELOAD_BYTES))) {
+                m_preloadOverflow = true;
+                qDebug() << "AudioFileReader: clip exceeds preload limit,"
+                            " keeping" << m_preloaded.size()
+                         << "bytes of its head";
+            }
+            else {
+                m_preloaded.append(dst, int(done));
+            }
+        }
+    }
+    if (done < size && !ferror(m_afp)) {
+        const bool unsigned8 = m_format.sampleSize() == 8
+                && m_format.sampleType() == QAudioFormat::UnSignedInt;
+        std::memset(dst + done, unsigned8 ? 0x80 : 0, size - done);
+    }
+    return done;
 }
 
 } // namespace RQPlayer
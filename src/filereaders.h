@@ -29,11 +29,22 @@
 #include <QAudioBuffer>
 
 #include <QAtomicInteger>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QVector>
+#include <QPair>
 
 #include <cstdio>
 
+#include "framepool.h"
+#include "checksums.h"
+
 namespace RQPlayer {
 
+struct DecompressBatch;
+
 class VideoFileReader : public QThread
 {
     Q_OBJECT
@@ -41,8 +52,31 @@ public:
     explicit VideoFileReader(const QString &fileName,
                              const QVideoSurfaceFormat &format,
                              QObject *parent = nullptr);
+    ~VideoFileReader();
     void stop();
 
+    // Every frame read is passed to verifier, which must outlive the reader
+    void setChecksumVerifier(ChecksumVerifier *verifier)
+    { m_checksumVerifier = verifier; }
+
+    // Frames read ahead of playback for image sequences
+    // (file name pattern like frame_%06d.yuv)
+    void setPrefetchDepth(int depth) { m_prefetchDepth = qMax(1, depth); }
+
+    // Restarts from the first frame at EOF instead of reopening the file.
+    // With preloadLimit (bytes) > 0 the first pass is kept in (locked)
+    // memory and later passes are played from there, or just the head of
+    // the clip if it doesn't fit.
+    void setLoop(bool loop, qint64 preloadLimit = 0)
+    { m_loop = loop; m_preloadLimit = preloadLimit; }
+
+    // Frames emitted per pass when looping, -1 until the first pass ended
+    qint64 loopLength() const;
+
+    // Waits up to timeoutMsec until frame index of the loop is known to
+    // exist (read in the first pass, or within the loop length)
+    bool waitForLoopFrame(qint64 index, unsigned long timeoutMsec);
+
 signals:
     void frameReady(const QVideoFrame &frame);
 
@@ -50,9 +84,44 @@ protected:
     void run() override;
 
 private:
+    void readRawFrames(int bytesCount, const QByteArray &prefix);
+    void readCompressedFrames(int bytesCount);
+    void readSequenceFrames(int bytesCount);
+    void finishBatch(DecompressBatch &batch);
+    void checksumFrame(QVideoFrame &frame);
+    void cacheFrame(const QVideoFrame &frame, qint64 nextOffset);
+    void releasePreloaded();
+    bool loopPreloaded();
+    void replayPreloadedHead();
+    bool rewindForLoop(qint64 dataOffset);
+    void emitFrame(const QVideoFrame &frame);
+    void endFirstPass();
+
     QString m_fileName;
     QVideoSurfaceFormat m_format;
     QAtomicInteger<bool> m_stopRequested;
+    QSharedPointer<FramePool> m_framePool;
+    QThreadPool m_workerPool;     // decompression and prefetch
+    int m_prefetchDepth = 8;
+    int m_wakeFd;
+    ChecksumVerifier *m_checksumVerifier = nullptr;
+    quint64 m_frameIndex = 0;
+    QVector<quint32> m_lastCrcs;    // of the last frame checksummed
+
+    bool m_loop = false;
+    qint64 m_preloadLimit = 0;
+    bool m_firstPass = true;
+    bool m_preloadOverflow = false;
+    QVector<QVideoFrame> m_preloaded;
+    QVector<QVector<quint32>> m_preloadedCrcs;
+    QVector<QPair<void *, size_t>> m_lockedRegions;
+    qint64 m_preloadedBytes = 0;
+    qint64 m_preloadResumeOffset = 0;   // file offset after the cached head
+
+    mutable QMutex m_loopMutex;
+    QWaitCondition m_loopProgress;
+    qint64 m_firstPassFrames = 0;
+    qint64 m_loopLength = -1;
 
     FILE *m_vfp;
 };
@@ -65,8 +134,22 @@ public:
                              const QAudioFormat &format,
                              double videoFrameRate,
                              QObject *parent = nullptr);
+    ~AudioFileReader();
     void stop();
 
+    // Every frame read is passed to verifier, which must outlive the reader
+    void setChecksumVerifier(ChecksumVerifier *verifier)
+    { m_checksumVerifier = verifier; }
+
+    // Same as VideoFileReader::setLoop(), the wrap is sample accurate
+    void setLoop(bool loop, qint64 preloadLimit = 0)
+    { m_loop = loop; m_preloadLimit = preloadLimit; }
+
+    // Wraps at the loop length of video instead, trimming the audio or
+    // padding it with silence, so both restart on the same frame.
+    // video must outlive the reader.
+    void setLoopVideo(VideoFileReader *video) { m_loopVideo = video; }
+
 signals:
     void samplesReady(const QAudioBuffer &abuf);
 
@@ -74,10 +157,28 @@ protected:
     void run() override;
 
 private:
+    size_t readLooped(char *dst, size_t size);
+    size_t readLoopFrame(char *dst, size_t size);
+
     QString m_fileName;
     QAudioFormat m_format;
     double m_videoFrameRate;
     QAtomicInteger<bool> m_stopRequested;
+    int m_wakeFd;
+    ChecksumVerifier *m_checksumVerifier = nullptr;
+    quint64 m_frameIndex = 0;
+
+    bool m_loop = false;
+    qint64 m_preloadLimit = 0;
+    VideoFileReader *m_loopVideo = nullptr;
+    bool m_firstPass = true;
+    bool m_preloadOverflow = false;
+    bool m_playFromMemory = false;
+    bool m_preloadLocked = false;
+    QByteArray m_preloaded;     // whole clip, or its head past the limit
+    int m_memoryPos = 0;
+    int m_headPos = -1;         // position in the head being replayed
+    qint64 m_fileBytes = -1;    // audio file size, once EOF was reached
 
     FILE *m_afp;
 };
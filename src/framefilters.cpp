@@ -0,0 +1,284 @@
+/* framefilters.cpp
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "framefilters.h"
+#include "videoplanes.h"
+
+#include <QRunnable>
+#include <cstring>
+#include <functional>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Rows below which a frame isn't worth splitting further
+#define MIN_ROWS_PER_SLICE      32
+// Per pixel difference from the previous frame still considered static
+#define MOTION_THRESHOLD        10
+
+namespace RQPlayer {
+
+namespace {
+
+class RowSliceTask : public QRunnable
+{
+public:
+    RowSliceTask(const std::function<void(int, int)> &work,
+                 int firstRow, int lastRow)
+        : m_work(work), m_firstRow(firstRow), m_lastRow(lastRow)
+    {
+    }
+
+    void run() override { m_work(m_firstRow, m_lastRow); }
+
+private:
+    const std::function<void(int, int)> &m_work;
+    int m_firstRow, m_lastRow;
+};
+
+// Calls work(firstRow, lastRow) for slices of rows in parallel, the first
+// slice on the calling thread, and waits for all of them
+void forEachRowSlice(QThreadPool &threadPool, int rows,
+                     const std::function<void(int, int)> &work)
+{
+    const int slices = qBound(1, rows / MIN_ROWS_PER_SLICE,
+                              threadPool.maxThreadCount() + 1);
+    for (int i = 1; i < slices; ++i) {
+        threadPool.start(new RowSliceTask(work, rows * i / slices,
+                                          rows * (i + 1) / slices));
+    }
+    work(0, rows / slices);
+    threadPool.waitForDone();
+}
+
+// dst = average of above and below
+void interpolateRow(const uchar *above, const uchar *below,
+                    uchar *dst, int width)
+{
+    int x = 0;
+#ifdef __SSE2__
+    for (; x + 16 <= width; x += 16) {
+        const __m128i a = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(above + x));
+        const __m128i b = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(below + x));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x),
+                         _mm_avg_epu8(a, b));
+    }
+#endif
+    for (; x < width; ++x) {
+        dst[x] = uchar((above[x] + below[x] + 1) >> 1);
+    }
+}
+
+// Keeps the current pixel (weave) where neither the surrounding lines of
+// the kept field nor the line itself (opposite field, as in yadif) changed
+// since the previous frame, otherwise interpolates like interpolateRow
+void motionAdaptiveRow(const uchar *above, const uchar *below,
+                       const uchar *current,
+                       const uchar *prevAbove, const uchar *prevBelow,
+                       const uchar *prevCurrent,
+                       uchar *dst, int width, int threshold)
+{
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i limit = _mm_set1_epi8(char(threshold));
+    for (; x + 16 <= width; x += 16) {
+        const __m128i a = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(above + x));
+        const __m128i b = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(below + x));
+        const __m128i c = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(current + x));
+        const __m128i pa = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(prevAbove + x));
+        const __m128i pb = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(prevBelow + x));
+        const __m128i pc = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(prevCurrent + x));
+        const __m128i diffA = _mm_or_si128(_mm_subs_epu8(a, pa),
+                                           _mm_subs_epu8(pa, a));
+        const __m128i diffB = _mm_or_si128(_mm_subs_epu8(b, pb),
+                                           _mm_subs_epu8(pb, b));
+        const __m128i diffC = _mm_or_si128(_mm_subs_epu8(c, pc),
+                                           _mm_subs_epu8(pc, c));
+        const __m128i motion = _mm_max_epu8(_mm_max_epu8(diffA, diffB),
+                                            diffC);
+        const __m128i still = _mm_cmpeq_epi8(_mm_subs_epu8(motion, limit),
+                                             zero);
+        const __m128i result = _mm_or_si128(
+                    _mm_and_si128(still, c),
+                    _mm_andnot_si128(still, _mm_avg_epu8(a, b)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), result);
+    }
+#endif
+    for (; x < width; ++x) {
+        const int motion = qMax(qMax(qAbs(above[x] - prevAbove[x]),
+                                     qAbs(below[x] - prevBelow[x])),
+                                qAbs(current[x] - prevCurrent[x]));
+        dst[x] = motion <= threshold
+                ? current[x] : uchar((above[x] + below[x] + 1) >> 1);
+    }
+}
+
+} // namespace
+
+
+Deinterlacer::Deinterlacer(Mode mode, bool topFieldFirst, bool doubleRate)
+    : m_mode(mode), m_topFieldFirst(topFieldFirst), m_doubleRate(doubleRate),
+      m_motionThreshold(MOTION_THRESHOLD)
+{
+}
+
+void Deinterlacer::filter(const QVideoFrame &frame,
+                          QVector<QVideoFrame> &output,
+                          QThreadPool &threadPool)
+{
+    QVideoFrame input(frame);
+    if (!input.map(QAbstractVideoBuffer::ReadOnly)) {
+        output.append(frame);
+        return;
+    }
+    const int height = input.height();
+    const int planes = input.planeCount();
+    if (!m_framePool || m_framePool->bufferSize() != input.mappedBytes()) {
+        m_framePool = QSharedPointer<FramePool>::create(input.mappedBytes());
+    }
+
+    QVideoFrame previous;
+    if (m_mode == MotionAdaptive && m_previous.isValid()) {
+        previous = m_previous;
+        if (!previous.map(QAbstractVideoBuffer::ReadOnly)) {
+            previous = QVideoFrame();
+        }
+        else if (previous.mappedBytes() != input.mappedBytes()) {
+            previous.unmap();
+            previous = QVideoFrame();
+        }
+    }
+
+    for (int field = 0; field < outputFramesPerInput(); ++field) {
+        const int keptParity = (m_topFieldFirst ? 0 : 1) ^ field;
+        QVideoFrame out = m_framePool->createFrame(
+                    input.size(), input.bytesPerLine(), input.pixelFormat());
+        out.map(QAbstractVideoBuffer::WriteOnly);
+        out.setStartTime(input.startTime());
+
+        // Plane layout resolved up front, workers only touch raw memory
+        struct Plane {
+            const uchar *src, *prev;
+            uchar *dst;
+            int stride, rows;
+        };
+        QVector<Plane> planeInfo;
+        for (int p = 0; p < planes; ++p) {
+            planeInfo.append({input.bits(p),
+                              previous.isValid() ? previous.bits(p) : nullptr,
+                              out.bits(p), input.bytesPerLine(p),
+                              planeRows(input, p)});
+        }
+
+        std::function<void(int, int)> work = [&](int firstRow, int lastRow) {
+            for (const Plane &plane : planeInfo) {
+                const int stride = plane.stride;
+                const int rows = plane.rows;
+                const int first = firstRow * rows / height;
+                const int last = lastRow * rows / height;
+                for (int row = first; row < last; ++row) {
+                    const uchar *src = plane.src + row * stride;
+                    uchar *dst = plane.dst + row * stride;
+                    if ((row & 1) == keptParity || rows < 2) {
+                        std::memcpy(dst, src, stride);
+                        continue;
+                    }
+                    const int above = row > 0 ? -stride : stride;
+                    const int below = row + 1 < rows ? stride : -stride;
+                    if (plane.prev) {
+                        const uchar *prev = plane.prev + row * stride;
+                        motionAdaptiveRow(src + above, src + below, src,
+                                          prev + above, prev + below, prev,
+                                          dst, stride, m_motionThreshold);
+                    }
+                    else {
+                        interpolateRow(src + above, src + below, dst, stride);
+                    }
+                }
+            }
+        };
+        forEachRowSlice(threadPool, height, work);
+
+        out.unmap();
+        output.append(out);
+    }
+
+    if (previous.isValid()) {
+        previous.unmap();
+    }
+    input.unmap();
+    if (m_mode == MotionAdaptive) {
+        m_previous = frame;
+    }
+}
+
+
+FilterStage::FilterStage(QObject *parent)
+    : QObject(parent)
+{
+    m_threadPool.setObjectName("FilterStage");
+}
+
+FilterStage::~FilterStage()
+{
+    m_threadPool.waitForDone();
+    qDeleteAll(m_filters);
+}
+
+void FilterStage::addFilter(FrameFilter *filter)
+{
+    m_filters.append(filter);
+}
+
+int FilterStage::outputFramesPerInput() const
+{
+    int frames = 1;
+    for (auto filter : m_filters) {
+        frames *= filter->outputFramesPerInput();
+    }
+    return frames;
+}
+
+void FilterStage::filterFrame(const QVideoFrame &frame)
+{
+    QVector<QVideoFrame> frames{frame};
+    for (auto filter : m_filters) {
+        QVector<QVideoFrame> output;
+        for (const auto &f : frames) {
+            filter->filter(f, output, m_threadPool);
+        }
+        frames = output;
+    }
+    for (const auto &f : frames) {
+        emit frameReady(f);
+    }
+}
+
+} // namespace RQPlayer
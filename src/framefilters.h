@@ -0,0 +1,103 @@
+/* framefilters.h
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RQPLAYER_FRAMEFILTERS_H
+#define RQPLAYER_FRAMEFILTERS_H
+
+#include <QObject>
+#include <QVideoFrame>
+#include <QVector>
+#include <QThreadPool>
+#include <QSharedPointer>
+
+#include "framepool.h"
+
+namespace RQPlayer {
+
+class FrameFilter
+{
+public:
+    virtual ~FrameFilter() {}
+
+    // Appends the frames produced for frame to output. Work may be split
+    // across threadPool, but must be finished before returning.
+    virtual void filter(const QVideoFrame &frame,
+                        QVector<QVideoFrame> &output,
+                        QThreadPool &threadPool) = 0;
+
+    // Number of frames produced for every input frame
+    virtual int outputFramesPerInput() const { return 1; }
+};
+
+class Deinterlacer : public FrameFilter
+{
+public:
+    enum Mode {
+        Bob,            // Interpolates the missing field lines
+        MotionAdaptive  // Keeps them where nothing moved since last frame
+    };
+
+    explicit Deinterlacer(Mode mode, bool topFieldFirst = true,
+                          bool doubleRate = false);
+
+    void filter(const QVideoFrame &frame,
+                QVector<QVideoFrame> &output,
+                QThreadPool &threadPool) override;
+
+    int outputFramesPerInput() const override { return m_doubleRate ? 2 : 1; }
+
+private:
+    Mode m_mode;
+    bool m_topFieldFirst;
+    bool m_doubleRate;
+    int m_motionThreshold;
+    QVideoFrame m_previous;
+    QSharedPointer<FramePool> m_framePool;
+};
+
+// Runs frames through a chain of filters, between the file readers and
+// the orchestrator. Filtering happens on the calling (reader) thread,
+// which hands row slices over to the stage's own thread pool.
+class FilterStage : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FilterStage(QObject *parent = nullptr);
+    ~FilterStage();
+
+    // Takes ownership of filter
+    void addFilter(FrameFilter *filter);
+    bool isEmpty() const { return m_filters.isEmpty(); }
+    int outputFramesPerInput() const;
+
+public slots:
+    void filterFrame(const QVideoFrame &frame);
+
+signals:
+    void frameReady(const QVideoFrame &frame);
+
+private:
+    QVector<FrameFilter *> m_filters;
+    QThreadPool m_threadPool;
+};
+
+} // namespace RQPlayer
+
+#endif // RQPLAYER_FRAMEFILTERS_H
@@ -0,0 +1,121 @@
+/* framepool.cpp
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "framepool.h"
+
+#include <QAbstractVideoBuffer>
+#include <QMutexLocker>
+
+namespace RQPlayer {
+
+namespace {
+
+class PooledVideoBuffer : public QAbstractVideoBuffer
+{
+public:
+    PooledVideoBuffer(const QSharedPointer<FramePool> &pool, int bytesPerLine)
+        : QAbstractVideoBuffer(NoHandle), m_pool(pool),
+          m_buffer(pool->takeBuffer()), m_bytesPerLine(bytesPerLine)
+    {
+    }
+
+    ~PooledVideoBuffer() override
+    {
+        m_pool->recycle(std::move(m_buffer));
+    }
+
+    MapMode mapMode() const override { return m_mapMode; }
+
+    uchar *map(MapMode mode, int *numBytes, int *bytesPerLine) override
+    {
+        if (m_mapMode != NotMapped || mode == NotMapped) {
+            return nullptr;
+        }
+        m_mapMode = mode;
+        if (numBytes) {
+            *numBytes = m_buffer.size();
+        }
+        if (bytesPerLine) {
+            *bytesPerLine = m_bytesPerLine;
+        }
+        return reinterpret_cast<uchar *>(m_buffer.data());
+    }
+
+    void unmap() override { m_mapMode = NotMapped; }
+
+private:
+    QSharedPointer<FramePool> m_pool;
+    QByteArray m_buffer;
+    int m_bytesPerLine;
+    MapMode m_mapMode = NotMapped;
+};
+
+} // namespace
+
+
+FramePool::FramePool(int bufferSize, int maxFreeBuffers)
+    : m_bufferSize(bufferSize), m_maxFreeBuffers(maxFreeBuffers)
+{
+}
+
+void FramePool::prewarm(int count)
+{
+    QVector<QByteArray> buffers;
+    for (int i = 0; i < count; ++i) {
+        QByteArray buffer = takeBuffer();
+        // Touch every page now rather than on the first fread
+        buffer.fill('\0');
+        buffers.append(std::move(buffer));
+    }
+    for (auto &buffer : buffers) {
+        recycle(std::move(buffer));
+    }
+}
+
+QVideoFrame FramePool::createFrame(const QSize &frameSize, int bytesPerLine,
+                                   QVideoFrame::PixelFormat pixelFormat)
+{
+    return QVideoFrame(new PooledVideoBuffer(sharedFromThis(), bytesPerLine),
+                       frameSize, pixelFormat);
+}
+
+QByteArray FramePool::takeBuffer()
+{
+    {
+        QMutexLocker lock(&m_mutex);
+        if (!m_freeBuffers.isEmpty()) {
+            return m_freeBuffers.takeLast();
+        }
+    }
+    return QByteArray(m_bufferSize, Qt::Uninitialized);
+}
+
+void FramePool::recycle(QByteArray &&buffer)
+{
+    if (buffer.size() != m_bufferSize) {
+        return;
+    }
+    QMutexLocker lock(&m_mutex);
+    if (m_freeBuffers.size() < m_maxFreeBuffers) {
+        m_freeBuffers.append(std::move(buffer));
+    }
+}
+
+} // namespace RQPlayer
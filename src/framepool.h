@@ -0,0 +1,62 @@
+/* framepool.h
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RQPLAYER_FRAMEPOOL_H
+#define RQPLAYER_FRAMEPOOL_H
+
+#include <QVideoFrame>
+#include <QByteArray>
+#include <QVector>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QEnableSharedFromThis>
+
+namespace RQPlayer {
+
+// Recycles fixed size frame buffers so that video frames flowing through
+// the pipeline don't allocate (and page fault) a fresh buffer every time.
+// Buffers go back to the pool when the last QVideoFrame referring to them
+// is released. Always create with QSharedPointer<FramePool>::create().
+class FramePool : public QEnableSharedFromThis<FramePool>
+{
+public:
+    explicit FramePool(int bufferSize, int maxFreeBuffers = 32);
+
+    int bufferSize() const { return m_bufferSize; }
+
+    // Allocates and touches count buffers up front
+    void prewarm(int count);
+
+    QVideoFrame createFrame(const QSize &frameSize, int bytesPerLine,
+                            QVideoFrame::PixelFormat pixelFormat);
+
+    QByteArray takeBuffer();
+    void recycle(QByteArray &&buffer);
+
+private:
+    const int m_bufferSize;
+    const int m_maxFreeBuffers;
+    QMutex m_mutex;
+    QVector<QByteArray> m_freeBuffers;
+};
+
+} // namespace RQPlayer
+
+#endif // RQPLAYER_FRAMEPOOL_H
@@ -55,7 +55,6 @@ signals:
 private:
     QAbstractVideoSurface *m_surface = nullptr;
     QVideoSurfaceFormat m_format;
-
 };
 
 } // namespace RQPlayer
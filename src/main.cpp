@@ -20,13 +20,25 @@
 
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
+#include <QQmlContext>
 #include <QCommandLineParser>
 #include <QFile>
+#include <QElapsedTimer>
+#include <QThread>
 
 #include "filereaders.h"
 #include "orchestrator.h"
 #include "framespresenter.h"
 #include "audiooutput.h"
+#include "audiometer.h"
+#include "checksums.h"
+#include "framefilters.h"
+#include "videoscopes.h"
+#include "scopeview.h"
+#include "rqvideoitem.h"
+
+// Upper bound of --prefetch, frames (and open files) in flight
+#define MAX_PREFETCH_DEPTH  64
 
 struct PlayerOptions {
     QString videoFile;
@@ -34,12 +46,26 @@ struct PlayerOptions {
     QSize frameSize;
     double frameRate;
     int audioChannels;
+    bool showScopes;
+    bool showMeters;
+    QString checksumLog;
+    QString checksumReference;
+    QString deinterlace;
+    bool doubleRate;
+    bool bottomFieldFirst;
+    int prefetchDepth;
+    bool loop;
+    bool preload;
+    int preloadLimitMB;
 };
 
 void processCommandLine(PlayerOptions &options);
 
 int main(int argc, char *argv[])
 {
+    QElapsedTimer startupTimer;
+    startupTimer.start();
+
     QCoreApplication::setApplicationName("RQPlayer");
     QCoreApplication::setApplicationVersion("1.0");
 
@@ -68,22 +94,12 @@ int main(int argc, char *argv[])
 
     using namespace RQPlayer;
     qmlRegisterType<FramesPresenter>("RQPlayer", 1, 0, "FramesPresenter");
-
-    const QUrl url{"qrc:/main.qml"};
-    QObject::connect(&engine, &QQmlApplicationEngine::objectCreated,
-                     &app, [url, options](QObject *obj, const QUrl &objUrl) {
-        if (url == objUrl) {
-            if (obj) {
-                obj->setProperty("width", options.frameSize.width());
-                obj->setProperty("height", options.frameSize.height());
-            }
-            else {
-                QCoreApplication::exit(-1);
-            }
-        }
-    }, Qt::QueuedConnection);
-
-    engine.load(url);
+    qmlRegisterType<ScopeView>("RQPlayer", 1, 0, "ScopeView");
+    qmlRegisterType<RQVideoItem>("RQPlayer", 1, 0, "RQVideoItem");
+    qmlRegisterUncreatableType<VideoScopes>("RQPlayer", 1, 0, "VideoScopes",
+                                            "Provided as videoScopes");
+    qmlRegisterUncreatableType<AudioMeter>("RQPlayer", 1, 0, "AudioMeter",
+                                           "Provided as audioMeter");
 
     QVideoSurfaceFormat videoFormat{
         options.frameSize, QVideoFrame::Format_YUV422P};
@@ -97,64 +113,228 @@ int main(int argc, char *argv[])
     audioFormat.setSampleSize(16);
     audioFormat.setSampleType(QAudioFormat::SignedInt);
 
-    auto rootObjects = engine.rootObjects();
-    if (rootObjects.isEmpty()) {
-        qDebug() << "QQmlApplicationEngine rootObjects is empty";
+    ChecksumVerifier checksumVerifier;
+    const bool verifyChecksums = !options.checksumLog.isEmpty()
+            || !options.checksumReference.isEmpty();
+    if (verifyChecksums && !crc32cSelfTest()) {
         return 1;
     }
-    QObject *rootObject = rootObjects.first();
-    FramesPresenter *presenter = rootObject->findChild<FramesPresenter *>();
-    if (!presenter) {
-        qDebug() << "Couldn't find FramesPresenter object under rootObject";
+    if (!options.checksumLog.isEmpty()
+            && !checksumVerifier.openLog(options.checksumLog)) {
+        return 1;
+    }
+    if (!options.checksumReference.isEmpty()
+            && !checksumVerifier.loadReference(options.checksumReference)) {
         return 1;
     }
-    presenter->setFormat(videoFormat);
 
-    AudioOutput audioOutput{audioFormat, &app};
+    // Audio device is opened on its own thread while the QML scene loads
+    QThread audioThread;
+    audioThread.setObjectName("AudioOutput");
+    AudioOutput audioOutput{audioFormat};
+    audioOutput.moveToThread(&audioThread);
+    audioThread.start();
+    QMetaObject::invokeMethod(&audioOutput, &AudioOutput::open,
+                              Qt::QueuedConnection);
 
+    // Readers are started before the QML scene is loaded so that opening
+    // the inputs and filling the orchestrator queues overlaps with it
     VideoFileReader videoFileReader{options.videoFile, videoFormat, &app};
     AudioFileReader audioFileReader{options.audioFile, audioFormat,
                 videoFormat.frameRate(), &app};
 
+    if (options.prefetchDepth > 0) {
+        videoFileReader.setPrefetchDepth(options.prefetchDepth);
+    }
+    if (options.loop) {
+        const qint64 preloadLimit = options.preload
+                ? qint64(options.preloadLimitMB) * 1024 * 1024 : 0;
+        videoFileReader.setLoop(true, preloadLimit);
+        audioFileReader.setLoop(true, preloadLimit);
+        if (!options.videoFile.isEmpty()) {
+            audioFileReader.setLoopVideo(&videoFileReader);
+        }
+    }
+    if (verifyChecksums) {
+        videoFileReader.setChecksumVerifier(&checksumVerifier);
+        audioFileReader.setChecksumVerifier(&checksumVerifier);
+    }
+
     Orchestrator orchestrator;
 
-    QObject::connect(&videoFileReader, &VideoFileReader::frameReady,
-                     &orchestrator, &Orchestrator::enqueueVideoFrame,
-                     Qt::DirectConnection);
+    FilterStage filterStage;
+    if (options.deinterlace == "bob" || options.deinterlace == "adaptive") {
+        filterStage.addFilter(new Deinterlacer(
+                    options.deinterlace == "bob" ? Deinterlacer::Bob
+                                                 : Deinterlacer::MotionAdaptive,
+                    !options.bottomFieldFirst, options.doubleRate));
+    }
+    else if (!options.deinterlace.isEmpty()) {
+        qDebug() << "Unknown deinterlace mode:" << options.deinterlace;
+    }
+    orchestrator.setFrameRate(videoFormat.frameRate());
+    orchestrator.setVideoFramesPerTick(filterStage.outputFramesPerInput());
+
+    VideoScopes videoScopes;
+    videoScopes.setEnabled(options.showScopes);
+    engine.rootContext()->setContextProperty("videoScopes", &videoScopes);
+
+    AudioMeter audioMeter{audioFormat};
+    audioMeter.setEnabled(options.showMeters);
+    engine.rootContext()->setContextProperty("audioMeter", &audioMeter);
+
+    if (filterStage.isEmpty()) {
+        QObject::connect(&videoFileReader, &VideoFileReader::frameReady,
+                         &orchestrator, &Orchestrator::enqueueVideoFrame,
+                         Qt::DirectConnection);
+    }
+    else {
+        QObject::connect(&videoFileReader, &VideoFileReader::frameReady,
+                         &filterStage, &FilterStage::filterFrame,
+                         Qt::DirectConnection);
+        QObject::connect(&filterStage, &FilterStage::frameReady,
+                         &orchestrator, &Orchestrator::enqueueVideoFrame,
+                         Qt::DirectConnection);
+    }
     QObject::connect(&audioFileReader, &AudioFileReader::samplesReady,
                      &orchestrator, &Orchestrator::enqueueAudioFrame,
                      Qt::DirectConnection);
 
-    QObject::connect(&orchestrator, &Orchestrator::videoFrameReady,
-                     presenter, &FramesPresenter::presentFrame,
-                     Qt::BlockingQueuedConnection);
-    QObject::connect(&orchestrator, &Orchestrator::audioFrameReady,
-                     &audioOutput, &AudioOutput::playAudio,
-                     Qt::BlockingQueuedConnection);
+    // Frames go to an RQVideoItem, or a FramesPresenter (VideoOutput) when
+    // the scene has no RQVideoItem
+    RQVideoItem *videoItem = nullptr;
+    FramesPresenter *presenter = nullptr;
 
-    QObject::connect(&app, &QGuiApplication::aboutToQuit,
-                     &app, [&]() {
+    auto stopPlayback = [&]() {
         QObject::disconnect(&videoFileReader, &VideoFileReader::frameReady,
                          &orchestrator, &Orchestrator::enqueueVideoFrame);
+        QObject::disconnect(&videoFileReader, &VideoFileReader::frameReady,
+                         &filterStage, &FilterStage::filterFrame);
         QObject::disconnect(&audioFileReader, &AudioFileReader::samplesReady,
                          &orchestrator, &Orchestrator::enqueueAudioFrame);
 
-        QObject::disconnect(&orchestrator, &Orchestrator::videoFrameReady,
-                         presenter, &FramesPresenter::presentFrame);
+        if (videoItem) {
+            QObject::disconnect(&orchestrator, &Orchestrator::videoFrameReady,
+                             videoItem, &RQVideoItem::presentFrame);
+        }
+        if (presenter) {
+            QObject::disconnect(&orchestrator, &Orchestrator::videoFrameReady,
+                             presenter, &FramesPresenter::presentFrame);
+        }
         QObject::disconnect(&orchestrator, &Orchestrator::audioFrameReady,
                          &audioOutput, &AudioOutput::playAudio);
+        QObject::disconnect(&orchestrator, &Orchestrator::videoFrameReady,
+                         &videoScopes, &VideoScopes::analyzeFrame);
+        QObject::disconnect(&orchestrator, &Orchestrator::audioFrameReady,
+                         &audioMeter, &AudioMeter::meterAudio);
+        orchestrator.stop();
+        // Presents already posted to this thread are delivered while
+        // waiting, so a blocking emit can't keep the orchestrator from
+        // finishing before the readers and the frame pool go away
+        orchestrator.quit();
+        while (!orchestrator.wait(10)) {
+            QCoreApplication::sendPostedEvents(nullptr, QEvent::MetaCall);
+        }
+        videoScopes.stop();
+        audioMeter.stop();
+        videoScopes.wait();
+        audioMeter.wait();
         videoFileReader.stop();
         audioFileReader.stop();
         videoFileReader.wait();
         audioFileReader.wait();
-        orchestrator.stop();
-    });
+        checksumVerifier.finish();
+    };
+
+    auto closeAudio = [&]() {
+        QMetaObject::invokeMethod(&audioOutput, &AudioOutput::close,
+                                  Qt::BlockingQueuedConnection);
+        audioThread.quit();
+        audioThread.wait();
+    };
 
     videoFileReader.start();
     audioFileReader.start();
+    videoScopes.start();
+    audioMeter.start();
+
+    const QUrl url{"qrc:/main.qml"};
+    QObject::connect(&engine, &QQmlApplicationEngine::objectCreated,
+                     &app, [url, options](QObject *obj, const QUrl &objUrl) {
+        if (url == objUrl) {
+            if (obj) {
+                obj->setProperty("width", options.frameSize.width());
+                obj->setProperty("height", options.frameSize.height());
+            }
+            else {
+                QCoreApplication::exit(-1);
+            }
+        }
+    }, Qt::QueuedConnection);
+
+    engine.load(url);
+    qDebug() << "QML scene loaded in" << startupTimer.elapsed() << "ms";
+
+    auto rootObjects = engine.rootObjects();
+    if (rootObjects.isEmpty()) {
+        qDebug() << "QQmlApplicationEngine rootObjects is empty";
+        stopPlayback();
+        closeAudio();
+        return 1;
+    }
+    QObject *rootObject = rootObjects.first();
+    videoItem = rootObject->findChild<RQVideoItem *>();
+    if (!videoItem) {
+        presenter = rootObject->findChild<FramesPresenter *>();
+    }
+    if (!videoItem && !presenter) {
+        qDebug() << "Couldn't find RQVideoItem or FramesPresenter object"
+                    " under rootObject";
+        stopPlayback();
+        closeAudio();
+        return 1;
+    }
+    if (videoItem) {
+        videoItem->setFormat(videoFormat);
+        QObject::connect(&orchestrator, &Orchestrator::videoFrameReady,
+                         videoItem, &RQVideoItem::presentFrame,
+                         Qt::BlockingQueuedConnection);
+    }
+    else {
+        presenter->setFormat(videoFormat);
+        QObject::connect(&orchestrator, &Orchestrator::videoFrameReady,
+                         presenter, &FramesPresenter::presentFrame,
+                         Qt::BlockingQueuedConnection);
+    }
+    // Queued behind the present call of the first frame, whichever
+    // presenter is in use
+    auto firstFrame = QSharedPointer<QMetaObject::Connection>::create();
+    *firstFrame = QObject::connect(
+                &orchestrator, &Orchestrator::videoFrameReady, &app,
+                [firstFrame, startupTimer]() {
+        if (QObject::disconnect(*firstFrame)) {
+            qDebug() << "Time to first presented frame:"
+                     << startupTimer.elapsed() << "ms";
+        }
+    }, Qt::QueuedConnection);
+    QObject::connect(&orchestrator, &Orchestrator::audioFrameReady,
+                     &audioOutput, &AudioOutput::playAudio,
+                     Qt::BlockingQueuedConnection);
+    QObject::connect(&orchestrator, &Orchestrator::videoFrameReady,
+                     &videoScopes, &VideoScopes::analyzeFrame,
+                     Qt::DirectConnection);
+    QObject::connect(&orchestrator, &Orchestrator::audioFrameReady,
+                     &audioMeter, &AudioMeter::meterAudio,
+                     Qt::DirectConnection);
+
+    QObject::connect(&app, &QGuiApplication::aboutToQuit,
+                     &app, stopPlayback);
+
     orchestrator.start();
 
-    return app.exec();
+    const int ret = app.exec();
+    closeAudio();
+    return ret;
 }
 
 void processCommandLine(PlayerOptions &options)
@@ -164,15 +344,40 @@ void processCommandLine(PlayerOptions &options)
                 "Raw video & audio frames player built with Qt.");
     parser.addHelpOption();
     parser.addOption({{"v", "video-file"},
-                      "Video file path", "file"});
+                      "Video file path, or image sequence pattern "
+                      "like frame_%06d.yuv", "file"});
     parser.addOption({{"a", "audio-file"},
                       "Audio file path", "file"});
+    parser.addOption({"prefetch",
+                      "Image sequence frames read ahead (default 8, "
+                      "at most 64)",
+                      "count"});
     parser.addOption({{"s", "frame-size"},
                       "Video frame size", "WxH"});
     parser.addOption({{"r", "frame-rate"},
                       "Frame rate", "fps"});
     parser.addOption({{"c", "audio-channels"},
                       "Audio channels", "count"});
+    parser.addOption({"scopes",
+                      "Show video scopes (toggle with S key)"});
+    parser.addOption({"meters",
+                      "Show audio meters (toggle with M key)"});
+    parser.addOption({"checksum-log",
+                      "Write per frame CRC32C checksums to file", "file"});
+    parser.addOption({"checksum-ref",
+                      "Verify frames against checksums in file", "file"});
+    parser.addOption({"deinterlace",
+                      "Deinterlace video: bob or adaptive", "mode"});
+    parser.addOption({"double-rate",
+                      "Deinterlace to one frame per field"});
+    parser.addOption({"bff",
+                      "Interlaced video is bottom field first"});
+    parser.addOption({"loop",
+                      "Loop playback instead of reopening the inputs at EOF"});
+    parser.addOption({"preload",
+                      "With --loop, play later passes from memory"});
+    parser.addOption({"preload-limit",
+                      "Memory for preloaded frames (default 2048)", "MB"});
     parser.process(QCoreApplication::arguments());
 
     // Set PlayerOptions from parsed command line arguments
@@ -185,4 +390,18 @@ void processCommandLine(PlayerOptions &options)
     }
     options.frameRate = parser.value("frame-rate").toDouble();
     options.audioChannels = parser.value("audio-channels").toInt();
+    options.showScopes = parser.isSet("scopes");
+    options.showMeters = parser.isSet("meters");
+    options.checksumLog = parser.value("checksum-log");
+    options.checksumReference = parser.value("checksum-ref");
+    options.deinterlace = parser.value("deinterlace");
+    options.doubleRate = parser.isSet("double-rate");
+    options.bottomFieldFirst = parser.isSet("bff");
+    options.prefetchDepth = parser.isSet("prefetch")
+            ? qBound(1, parser.value("prefetch").toInt(), MAX_PREFETCH_DEPTH)
+            : 0;
+    options.loop = parser.isSet("loop");
+    options.preload = parser.isSet("preload");
+    options.preloadLimitMB = parser.isSet("preload-limit")
+            ? parser.value("preload-limit").toInt() : 2048;
 }
@@ -20,7 +20,6 @@
 
 import QtQuick 2.15
 import QtQuick.Window 2.15
-import QtMultimedia 5.12
 
 import RQPlayer 1.0
 
@@ -31,13 +30,127 @@ Window {
     color: "black"
     title: qsTr("RQPlayer")
 
-    FramesPresenter {
-        id: presenter
+    RQVideoItem {
+        id: output
+        anchors.fill: parent
     }
 
-    VideoOutput {
-        id: output
-        source: presenter
+    Item {
         anchors.fill: parent
+        focus: true
+        Keys.onPressed: {
+            if (event.key === Qt.Key_S) {
+                videoScopes.enabled = !videoScopes.enabled
+            }
+            else if (event.key === Qt.Key_M) {
+                audioMeter.enabled = !audioMeter.enabled
+            }
+        }
+    }
+
+    Row {
+        id: scopes
+        anchors.left: parent.left
+        anchors.bottom: parent.bottom
+        anchors.margins: 8
+        spacing: 8
+        visible: videoScopes.enabled
+
+        property real scopeSize: Math.min(256, (parent.width - 32) / 3)
+
+        ScopeView {
+            scopes: videoScopes
+            scope: VideoScopes.Histogram
+            width: parent.scopeSize
+            height: parent.scopeSize / 2
+            anchors.bottom: parent.bottom
+        }
+        ScopeView {
+            scopes: videoScopes
+            scope: VideoScopes.Waveform
+            width: parent.scopeSize
+            height: parent.scopeSize
+        }
+        ScopeView {
+            scopes: videoScopes
+            scope: VideoScopes.Vectorscope
+            width: parent.scopeSize
+            height: parent.scopeSize
+        }
+    }
+
+    Rectangle {
+        id: meters
+        anchors.right: parent.right
+        anchors.top: parent.top
+        anchors.bottom: parent.bottom
+        anchors.margins: 8
+        width: Math.max(bars.width, loudness.width) + 16
+        color: "#a0000000"
+        visible: audioMeter.enabled
+
+        // Bar height for a level in dB, -60 dB at the bottom
+        function levelHeight(db, range) {
+            return Math.max(0, Math.min(1, (db + 60) / 60)) * range
+        }
+
+        Row {
+            id: bars
+            anchors.top: parent.top
+            anchors.bottom: loudness.top
+            anchors.horizontalCenter: parent.horizontalCenter
+            anchors.margins: 8
+            spacing: 2
+
+            // Fixed delegates, only their heights follow the levels
+            Repeater {
+                model: audioMeter.channelCount
+                Rectangle {
+                    width: 6
+                    height: bars.height
+                    color: "#202020"
+
+                    property real level: audioMeter.peakLevels[index]
+
+                    Rectangle {
+                        anchors.bottom: parent.bottom
+                        width: parent.width
+                        height: meters.levelHeight(parent.level,
+                                                   parent.height)
+                        color: parent.level > -9 ? "red"
+                                                 : parent.level > -18
+                                                   ? "yellow" : "lime"
+                    }
+                }
+            }
+        }
+
+        Column {
+            id: loudness
+            anchors.bottom: parent.bottom
+            anchors.horizontalCenter: parent.horizontalCenter
+            anchors.margins: 8
+
+            Text {
+                text: "M " + audioMeter.momentaryLoudness.toFixed(1)
+                color: "white"
+                font.pixelSize: 10
+            }
+            Text {
+                text: "S " + audioMeter.shortTermLoudness.toFixed(1)
+                color: "white"
+                font.pixelSize: 10
+            }
+            Text {
+                text: "I " + audioMeter.integratedLoudness.toFixed(1)
+                color: "white"
+                font.pixelSize: 10
+            }
+            Text {
+                text: "TP " + audioMeter.truePeak.toFixed(1)
+                color: "white"
+                font.pixelSize: 10
+            }
+        }
     }
 }
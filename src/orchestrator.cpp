@@ -21,7 +21,7 @@
 #include "orchestrator.h"
 
 #include <QMutexLocker>
-#include <QDateTime>
+#include <QElapsedTimer>
 
 #define MAX_QUEUE_SIZE  12
 #define MIN_QUEUE_SIZE  1
@@ -40,23 +40,40 @@ Orchestrator::~Orchestrator()
 void Orchestrator::stop()
 {
     m_stopRequested = true;
+
+    // Release readers blocked on a full queue, e.g. when the pipeline is
+    // torn down before it ever started draining
+    {
+        QMutexLocker lock(&m_videoQueueMutex);
+        m_videoQueueNotFull.wakeAll();
+    }
+    {
+        QMutexLocker lock(&m_audioQueueMutex);
+        m_audioQueueNotFull.wakeAll();
+    }
 }
 
 void Orchestrator::enqueueVideoFrame(const QVideoFrame &frame)
 {
     QMutexLocker lock(&m_videoQueueMutex);
-    while (m_videoFrameQueue.size() >= MAX_QUEUE_SIZE) {
+    while (m_videoFrameQueue.size() >= MAX_QUEUE_SIZE && !m_stopRequested) {
         m_videoQueueNotFull.wait(&m_videoQueueMutex);
     }
+    if (m_stopRequested) {
+        return;
+    }
     m_videoFrameQueue.enqueue(frame);
 }
 
 void Orchestrator::enqueueAudioFrame(const QAudioBuffer &abuf)
 {
     QMutexLocker lock(&m_audioQueueMutex);
-    while (m_audioFrameQueue.size() >= MAX_QUEUE_SIZE) {
+    while (m_audioFrameQueue.size() >= MAX_QUEUE_SIZE && !m_stopRequested) {
         m_audioQueueNotFull.wait(&m_audioQueueMutex);
     }
+    if (m_stopRequested) {
+        return;
+    }
     m_audioFrameQueue.enqueue(abuf);
 }
 
@@ -97,27 +114,31 @@ bool Orchestrator::sendAudioFrame()
 
 void Orchestrator::run()
 {
-    const auto frameDurMsec = 40;
-    QDateTime nextFrameTime = QDateTime::currentDateTime().addMSecs(
-                frameDurMsec);
+    const qint64 frameDurUsec = qRound64(1000000 / m_frameRate);
+    QElapsedTimer clock;
+    clock.start();
+    qint64 nextFrameUsec = frameDurUsec;
     while (!m_stopRequested) {
-        if (videoFrameQueueSize() >= MIN_QUEUE_SIZE
+        if (videoFrameQueueSize() >= MIN_QUEUE_SIZE * m_videoFramesPerTick
                 && audioFrameQueueSize() >= MIN_QUEUE_SIZE) {
             sendVideoFrame();
             sendAudioFrame();
+            for (int i = 1; i < m_videoFramesPerTick; ++i) {
+                QThread::usleep(frameDurUsec / m_videoFramesPerTick);
+                sendVideoFrame();
+            }
         }
         else {
             QThread::usleep(10000);
             continue;
         }
-        auto sleepMsec = QDateTime::currentDateTime().msecsTo(
-                    nextFrameTime);
-        if (sleepMsec > 0) {
-            QThread::usleep(sleepMsec * 1000);
-            nextFrameTime = nextFrameTime.addMSecs(frameDurMsec);
+        auto sleepUsec = nextFrameUsec - clock.nsecsElapsed() / 1000;
+        if (sleepUsec > 0) {
+            QThread::usleep(sleepUsec);
+            nextFrameUsec += frameDurUsec;
         }
         else {
-            nextFrameTime = QDateTime::currentDateTime().addMSecs(frameDurMsec);
+            nextFrameUsec = clock.nsecsElapsed() / 1000 + frameDurUsec;
         }
     }
 }
@@ -43,6 +43,14 @@ public:
 
     void stop();
 
+    // Video frames sent, evenly spaced, along with every audio frame
+    // (e.g. 2 when deinterlacing to field rate)
+    void setVideoFramesPerTick(int frames) { m_videoFramesPerTick = frames; }
+
+    // Rate of the audio frames (ticks), the input video frame rate
+    void setFrameRate(double frameRate)
+    { m_frameRate = frameRate > 0 ? frameRate : 25; }
+
 public slots:
     void enqueueVideoFrame(const QVideoFrame &frame);
     void enqueueAudioFrame(const QAudioBuffer &abuf);
@@ -61,6 +69,8 @@ private:
     bool sendAudioFrame();
 
     QAtomicInteger<bool> m_stopRequested;
+    int m_videoFramesPerTick = 1;
+    double m_frameRate = 25;
 
     QQueue<QVideoFrame> m_videoFrameQueue;
     QQueue<QAudioBuffer> m_audioFrameQueue;
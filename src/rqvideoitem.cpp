@@ -0,0 +1,433 @@
+/* rqvideoitem.cpp
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "rqvideoitem.h"
+#include "videoplanes.h"
+
+#include <QQuickWindow>
+#include <QSGGeometryNode>
+#include <QSGMaterial>
+#include <QSGImageNode>
+#include <QSGRendererInterface>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QMatrix4x4>
+#include <QVector2D>
+#include <QDebug>
+
+#include <cmath>
+
+namespace RQPlayer {
+
+namespace {
+
+bool isSupportedFormat(QVideoFrame::PixelFormat pixelFormat)
+{
+    return pixelFormat == QVideoFrame::Format_YUV422P
+            || pixelFormat == QVideoFrame::Format_YUV420P
+            || pixelFormat == QVideoFrame::Format_YV12;
+}
+
+// 8 bit YUV scaled to 0..1 into RGB, for the given luma coefficients
+QMatrix4x4 yuvToRgbMatrix(float kr, float kb, bool fullRange)
+{
+    const float kg = 1.0f - kr - kb;
+    const float ys = fullRange ? 1.0f : 255.0f / 219.0f;
+    const float cs = fullRange ? 1.0f : 255.0f / 224.0f;
+    const float yo = fullRange ? 0.0f : 16.0f / 255.0f;
+    const float co = 128.0f / 255.0f;
+    const float rv = 2.0f * (1.0f - kr) * cs;
+    const float bu = 2.0f * (1.0f - kb) * cs;
+    const float gu = -bu * kb / kg;
+    const float gv = -rv * kr / kg;
+    return QMatrix4x4(ys, 0.0f, rv, -ys * yo - rv * co,
+                      ys, gu, gv, -ys * yo - (gu + gv) * co,
+                      ys, bu, 0.0f, -ys * yo - bu * co,
+                      0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+// BT.709 for HD and BT.601 for SD sizes, unless the format says otherwise
+QMatrix4x4 colorMatrix(const QVideoSurfaceFormat &format, int frameHeight)
+{
+    switch (format.yCbCrColorSpace()) {
+    case QVideoSurfaceFormat::YCbCr_JPEG:
+        return yuvToRgbMatrix(0.299f, 0.114f, true);
+    case QVideoSurfaceFormat::YCbCr_BT601:
+    case QVideoSurfaceFormat::YCbCr_xvYCC601:
+        return yuvToRgbMatrix(0.299f, 0.114f, false);
+    case QVideoSurfaceFormat::YCbCr_BT709:
+    case QVideoSurfaceFormat::YCbCr_xvYCC709:
+        return yuvToRgbMatrix(0.2126f, 0.0722f, false);
+    default:
+        return frameHeight >= 720 ? yuvToRgbMatrix(0.2126f, 0.0722f, false)
+                                  : yuvToRgbMatrix(0.299f, 0.114f, false);
+    }
+}
+
+// For the software conversion
+inline uchar clampToByte(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+class VideoMaterial : public QSGMaterial
+{
+public:
+    VideoMaterial()
+    {
+        setFlag(Blending, false);
+    }
+
+    ~VideoMaterial()
+    {
+        // Nodes are destroyed on the render thread, with the context current
+        QOpenGLContext *context = QOpenGLContext::currentContext();
+        if (context && m_textures[0]) {
+            context->functions()->glDeleteTextures(3, m_textures);
+        }
+    }
+
+    QSGMaterialType *type() const override
+    {
+        static QSGMaterialType type;
+        return &type;
+    }
+
+    QSGMaterialShader *createShader() const override;
+
+    // The frame is uploaded (and released) the next time it's rendered
+    void setFrame(const QVideoFrame &frame, const QMatrix4x4 &colorMatrix)
+    {
+        m_frame = frame;
+        m_colorMatrix = colorMatrix;
+    }
+
+    const QMatrix4x4 &colorMatrix() const { return m_colorMatrix; }
+    QVector2D textureScale() const { return {m_textureScale, 1.0f}; }
+
+    void bindTextures(QOpenGLFunctions *gl)
+    {
+        if (!m_textures[0]) {
+            gl->glGenTextures(3, m_textures);
+            for (GLuint texture : m_textures) {
+                gl->glBindTexture(GL_TEXTURE_2D, texture);
+                gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                                    GL_LINEAR);
+                gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                                    GL_LINEAR);
+                gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
+                                    GL_CLAMP_TO_EDGE);
+                gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
+                                    GL_CLAMP_TO_EDGE);
+            }
+        }
+        if (m_frame.isValid()) {
+            uploadFrame(gl);
+        }
+        // Unit 0 last, the scene graph expects it to be the active one
+        for (int unit = 2; unit >= 0; --unit) {
+            gl->glActiveTexture(GL_TEXTURE0 + unit);
+            gl->glBindTexture(GL_TEXTURE_2D, m_textures[unit]);
+        }
+    }
+
+private:
+    void uploadFrame(QOpenGLFunctions *gl)
+    {
+        QVideoFrame frame(m_frame);
+        m_frame = QVideoFrame();
+        if (!frame.map(QAbstractVideoBuffer::ReadOnly)) {
+            return;
+        }
+        if (frame.planeCount() < 3) {
+            frame.unmap();
+            return;
+        }
+        const bool swapUV = frame.pixelFormat() == QVideoFrame::Format_YV12;
+        // Straight from the pooled buffer into the persistent textures,
+        // reallocated only when the plane sizes change. Textures are as
+        // wide as the lines, the padding is cut off by texScale.
+        gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int p = 0; p < 3; ++p) {
+            const int plane = swapUV && p > 0 ? 3 - p : p;
+            const QSize size(frame.bytesPerLine(plane),
+                             planeRows(frame, plane));
+            gl->glBindTexture(GL_TEXTURE_2D, m_textures[p]);
+            if (size != m_textureSizes[p]) {
+                gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
+                                 size.width(), size.height(), 0,
+                                 GL_LUMINANCE, GL_UNSIGNED_BYTE,
+                                 frame.bits(plane));
+                m_textureSizes[p] = size;
+            }
+            else {
+                gl->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+                                    size.width(), size.height(),
+                                    GL_LUMINANCE, GL_UNSIGNED_BYTE,
+                                    frame.bits(plane));
+            }
+        }
+        gl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        m_textureScale = float(frame.width()) / frame.bytesPerLine(0);
+        frame.unmap();
+    }
+
+    QVideoFrame m_frame;
+    QMatrix4x4 m_colorMatrix;
+    GLuint m_textures[3] = {0, 0, 0};
+    QSize m_textureSizes[3];
+    float m_textureScale = 1.0f;
+};
+
+class VideoMaterialShader : public QSGMaterialShader
+{
+public:
+    VideoMaterialShader()
+    {
+        setShaderSourceFile(QOpenGLShader::Vertex,
+                            ":/shaders/rqvideoitem.vert");
+        setShaderSourceFile(QOpenGLShader::Fragment,
+                            ":/shaders/rqvideoitem.frag");
+    }
+
+    char const *const *attributeNames() const override
+    {
+        static const char *const names[] = {"vertex", "texCoord", nullptr};
+        return names;
+    }
+
+    void updateState(const RenderState &state, QSGMaterial *newMaterial,
+                     QSGMaterial *oldMaterial) override
+    {
+        Q_UNUSED(oldMaterial);
+        auto material = static_cast<VideoMaterial *>(newMaterial);
+        material->bindTextures(state.context()->functions());
+
+        program()->setUniformValue(m_yTextureId, 0);
+        program()->setUniformValue(m_uTextureId, 1);
+        program()->setUniformValue(m_vTextureId, 2);
+        program()->setUniformValue(m_colorMatrixId, material->colorMatrix());
+        program()->setUniformValue(m_texScaleId, material->textureScale());
+        if (state.isOpacityDirty()) {
+            program()->setUniformValue(m_opacityId, state.opacity());
+        }
+        if (state.isMatrixDirty()) {
+            program()->setUniformValue(m_matrixId, state.combinedMatrix());
+        }
+    }
+
+protected:
+    void initialize() override
+    {
+        m_matrixId = program()->uniformLocation("matrix");
+        m_texScaleId = program()->uniformLocation("texScale");
+        m_yTextureId = program()->uniformLocation("yTexture");
+        m_uTextureId = program()->uniformLocation("uTexture");
+        m_vTextureId = program()->uniformLocation("vTexture");
+        m_colorMatrixId = program()->uniformLocation("colorMatrix");
+        m_opacityId = program()->uniformLocation("opacity");
+    }
+
+private:
+    int m_matrixId = -1;
+    int m_texScaleId = -1;
+    int m_yTextureId = -1;
+    int m_uTextureId = -1;
+    int m_vTextureId = -1;
+    int m_colorMatrixId = -1;
+    int m_opacityId = -1;
+};
+
+QSGMaterialShader *VideoMaterial::createShader() const
+{
+    return new VideoMaterialShader;
+}
+
+class VideoNode : public QSGGeometryNode
+{
+public:
+    VideoNode()
+        : m_geometry(QSGGeometry::defaultAttributes_TexturedPoint2D(), 4)
+    {
+        setGeometry(&m_geometry);
+        setMaterial(&m_material);
+    }
+
+    void setFrame(const QVideoFrame &frame, const QMatrix4x4 &colorMatrix)
+    {
+        m_material.setFrame(frame, colorMatrix);
+        markDirty(DirtyMaterial);
+    }
+
+    void setRect(const QRectF &rect)
+    {
+        if (rect != m_rect) {
+            m_rect = rect;
+            QSGGeometry::updateTexturedRectGeometry(&m_geometry, rect,
+                                                    QRectF(0, 0, 1, 1));
+            markDirty(DirtyGeometry);
+        }
+    }
+
+private:
+    QSGGeometry m_geometry;
+    VideoMaterial m_material;
+    QRectF m_rect;
+};
+
+} // namespace
+
+
+RQVideoItem::RQVideoItem(QQuickItem *parent)
+    : QQuickItem(parent)
+{
+    setFlag(ItemHasContents, true);
+}
+
+void RQVideoItem::setFormat(const QVideoSurfaceFormat &format)
+{
+    if (!isSupportedFormat(format.pixelFormat())) {
+        qDebug() << "RQVideoItem: unsupported pixel format:"
+                 << format.pixelFormat();
+    }
+    m_format = format;
+    update();
+}
+
+void RQVideoItem::presentFrame(const QVideoFrame &frame)
+{
+    if (!frame.isValid() || !isSupportedFormat(frame.pixelFormat())) {
+        return;
+    }
+    m_frame = frame;
+    m_frameChanged = true;
+    update();
+}
+
+QRectF RQVideoItem::videoRect() const
+{
+    QSizeF size = m_frame.size();
+    const QSize aspect = m_format.pixelAspectRatio();
+    if (aspect.isValid() && aspect.height() > 0) {
+        size.rwidth() *= qreal(aspect.width()) / aspect.height();
+    }
+    size.scale(width(), height(), Qt::KeepAspectRatio);
+    return QRectF((width() - size.width()) / 2,
+                  (height() - size.height()) / 2,
+                  size.width(), size.height());
+}
+
+QSGNode *RQVideoItem::updatePaintNode(QSGNode *oldNode,
+                                      UpdatePaintNodeData *data)
+{
+    Q_UNUSED(data);
+    // Called on the render thread with the GUI thread blocked, so the
+    // frame can be picked up without locking
+    if (!m_frame.isValid() || width() <= 0 || height() <= 0) {
+        delete oldNode;
+        return nullptr;
+    }
+
+    if (window()->rendererInterface()->graphicsApi()
+            == QSGRendererInterface::OpenGL) {
+        auto node = static_cast<VideoNode *>(oldNode);
+        if (!node) {
+            node = new VideoNode;
+        }
+        if (m_frameChanged) {
+            node->setFrame(m_frame, colorMatrix(m_format, m_frame.height()));
+            m_frameChanged = false;
+        }
+        node->setRect(videoRect());
+        return node;
+    }
+
+    // Software backend, no shaders: converted here into a QImage
+    auto node = static_cast<QSGImageNode *>(oldNode);
+    if (m_frameChanged) {
+        convertToImage(m_frame);
+        m_frameChanged = false;
+        if (!m_image.isNull()) {
+            if (!node) {
+                node = window()->createImageNode();
+                node->setOwnsTexture(true);
+            }
+            node->setTexture(window()->createTextureFromImage(m_image));
+        }
+    }
+    if (node) {
+        node->setRect(videoRect());
+    }
+    return node;
+}
+
+void RQVideoItem::convertToImage(QVideoFrame &frame)
+{
+    if (!frame.map(QAbstractVideoBuffer::ReadOnly)) {
+        return;
+    }
+    if (frame.planeCount() < 3) {
+        frame.unmap();
+        return;
+    }
+    const int width = frame.width();
+    const int height = frame.height();
+    if (m_image.size() != frame.size()) {
+        m_image = QImage(frame.size(), QImage::Format_RGB32);
+    }
+
+    // Fixed point (8 fractional bits) version of the shader's matrix
+    const QMatrix4x4 matrix = colorMatrix(m_format, height);
+    int c[3][4];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            c[i][j] = int(std::lround(matrix(i, j) * 256));
+        }
+        c[i][3] = int(std::lround(matrix(i, 3) * 255 * 256)) + 128;
+    }
+
+    const bool swapUV = frame.pixelFormat() == QVideoFrame::Format_YV12;
+    const int uPlane = swapUV ? 2 : 1;
+    const int vPlane = swapUV ? 1 : 2;
+    const int chromaRows = planeRows(frame, uPlane);
+    for (int row = 0; row < height; ++row) {
+        const int chromaRow = row * chromaRows / height;
+        const uchar *y = frame.bits(0) + row * frame.bytesPerLine(0);
+        const uchar *u = frame.bits(uPlane)
+                + chromaRow * frame.bytesPerLine(uPlane);
+        const uchar *v = frame.bits(vPlane)
+                + chromaRow * frame.bytesPerLine(vPlane);
+        QRgb *line = reinterpret_cast<QRgb *>(m_image.scanLine(row));
+        for (int x = 0; x < width; ++x) {
+            const int yy = y[x], uu = u[x / 2], vv = v[x / 2];
+            line[x] = qRgb(
+                    clampToByte((c[0][0] * yy + c[0][1] * uu + c[0][2] * vv
+                                 + c[0][3]) >> 8),
+                    clampToByte((c[1][0] * yy + c[1][1] * uu + c[1][2] * vv
+                                 + c[1][3]) >> 8),
+                    clampToByte((c[2][0] * yy + c[2][1] * uu + c[2][2] * vv
+                                 + c[2][3]) >> 8));
+        }
+    }
+    frame.unmap();
+}
+
+} // namespace RQPlayer
@@ -0,0 +1,64 @@
+/* rqvideoitem.h
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RQPLAYER_RQVIDEOITEM_H
+#define RQPLAYER_RQVIDEOITEM_H
+
+#include <QQuickItem>
+#include <QVideoFrame>
+#include <QVideoSurfaceFormat>
+#include <QImage>
+
+namespace RQPlayer {
+
+// Renders planar YUV frames (YUV422P, YUV420P, YV12) without going through
+// VideoOutput. With OpenGL the planes are uploaded as they are into
+// persistent textures and converted to RGB by a fragment shader; other
+// scene graph backends (software) get frames converted on the CPU.
+class RQVideoItem : public QQuickItem
+{
+    Q_OBJECT
+
+public:
+    explicit RQVideoItem(QQuickItem *parent = nullptr);
+
+    const QVideoSurfaceFormat &format() const { return m_format; }
+    void setFormat(const QVideoSurfaceFormat &format);
+
+public slots:
+    void presentFrame(const QVideoFrame &frame);
+
+protected:
+    QSGNode *updatePaintNode(QSGNode *oldNode,
+                             UpdatePaintNodeData *data) override;
+
+private:
+    QRectF videoRect() const;
+    void convertToImage(QVideoFrame &frame);
+
+    QVideoSurfaceFormat m_format;
+    QVideoFrame m_frame;
+    bool m_frameChanged = false;
+    QImage m_image;     // software backend only
+};
+
+} // namespace RQPlayer
+
+#endif // RQPLAYER_RQVIDEOITEM_H
@@ -0,0 +1,42 @@
+/* rqzformat.h
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RQPLAYER_RQZFORMAT_H
+#define RQPLAYER_RQZFORMAT_H
+
+// RQZ: raw video frames, each compressed as an independent LZ4 block so
+// that frames can be decompressed in parallel. Shared with tools/rqpack.
+//
+//   header:  "RQZ1" | u32 frame bytes | u32 frame count (0 if unknown)
+//   frame:   u32 block size | block
+//            (RQZ_STORED_FLAG set in block size: stored uncompressed)
+//   end:     u32 0
+//   index:   u64 file offset of each frame | u64 index offset | "RQZI"
+//
+// All integers are little-endian. The index is optional, players reading
+// sequentially (e.g. from a pipe) stop at the end marker.
+
+#define RQZ_MAGIC           "RQZ1"
+#define RQZ_INDEX_MAGIC     "RQZI"
+#define RQZ_MAGIC_SIZE      4
+#define RQZ_HEADER_SIZE     12
+#define RQZ_STORED_FLAG     0x80000000u
+
+#endif // RQPLAYER_RQZFORMAT_H
@@ -0,0 +1,72 @@
+/* scopeview.cpp
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "scopeview.h"
+
+#include <QPainter>
+
+namespace RQPlayer {
+
+ScopeView::ScopeView(QQuickItem *parent)
+    : QQuickPaintedItem(parent)
+{
+}
+
+void ScopeView::setScopes(VideoScopes *scopes)
+{
+    if (m_scopes == scopes) {
+        return;
+    }
+    if (m_scopes) {
+        disconnect(m_scopes, nullptr, this, nullptr);
+    }
+    m_scopes = scopes;
+    if (m_scopes) {
+        // Queued, as scopes are updated from the analysis thread
+        connect(m_scopes, &VideoScopes::scopesUpdated,
+                this, [this]() { update(); }, Qt::QueuedConnection);
+    }
+    update();
+    emit scopesChanged(m_scopes);
+}
+
+void ScopeView::setScope(int scope)
+{
+    if (m_scope != scope) {
+        m_scope = scope;
+        update();
+        emit scopeChanged(m_scope);
+    }
+}
+
+void ScopeView::paint(QPainter *painter)
+{
+    if (!m_scopes || m_scope < VideoScopes::Histogram
+            || m_scope > VideoScopes::Vectorscope) {
+        return;
+    }
+    const QImage image = m_scopes->scopeImage(
+                static_cast<VideoScopes::Scope>(m_scope));
+    if (!image.isNull()) {
+        painter->drawImage(boundingRect(), image);
+    }
+}
+
+} // namespace RQPlayer
@@ -0,0 +1,67 @@
+/* scopeview.h
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RQPLAYER_SCOPEVIEW_H
+#define RQPLAYER_SCOPEVIEW_H
+
+#include <QQuickPaintedItem>
+#include <QPointer>
+
+#include "videoscopes.h"
+
+namespace RQPlayer {
+
+// Draws one of the images computed by VideoScopes
+class ScopeView : public QQuickPaintedItem
+{
+    Q_OBJECT
+
+    Q_PROPERTY(RQPlayer::VideoScopes *scopes
+               READ scopes
+               WRITE setScopes
+               NOTIFY scopesChanged)
+    Q_PROPERTY(int scope
+               READ scope
+               WRITE setScope
+               NOTIFY scopeChanged)
+
+public:
+    explicit ScopeView(QQuickItem *parent = nullptr);
+
+    VideoScopes *scopes() const { return m_scopes; }
+    void setScopes(VideoScopes *scopes);
+
+    int scope() const { return m_scope; }
+    void setScope(int scope);
+
+    void paint(QPainter *painter) override;
+
+signals:
+    void scopesChanged(RQPlayer::VideoScopes *scopes);
+    void scopeChanged(int scope);
+
+private:
+    QPointer<VideoScopes> m_scopes;
+    int m_scope = VideoScopes::Histogram;
+};
+
+} // namespace RQPlayer
+
+#endif // RQPLAYER_SCOPEVIEW_H
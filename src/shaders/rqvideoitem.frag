@@ -0,0 +1,17 @@
+uniform sampler2D yTexture;
+uniform sampler2D uTexture;
+uniform sampler2D vTexture;
+uniform mediump mat4 colorMatrix;
+uniform lowp float opacity;
+varying highp vec2 qt_TexCoord;
+
+void main()
+{
+    // Planes are single channel textures, .r works for both luminance
+    // and red formats
+    mediump vec4 yuv = vec4(texture2D(yTexture, qt_TexCoord).r,
+                            texture2D(uTexture, qt_TexCoord).r,
+                            texture2D(vTexture, qt_TexCoord).r,
+                            1.0);
+    gl_FragColor = vec4((colorMatrix * yuv).rgb, 1.0) * opacity;
+}
@@ -0,0 +1,11 @@
+attribute highp vec4 vertex;
+attribute highp vec2 texCoord;
+uniform highp mat4 matrix;
+uniform highp vec2 texScale;
+varying highp vec2 qt_TexCoord;
+
+void main()
+{
+    qt_TexCoord = texCoord * texScale;
+    gl_Position = matrix * vertex;
+}
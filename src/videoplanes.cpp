@@ -0,0 +1,37 @@
+/* videoplanes.cpp
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "videoplanes.h"
+
+namespace RQPlayer {
+
+int planeBytes(const QVideoFrame &frame, int plane)
+{
+    const uchar *end = plane + 1 < frame.planeCount()
+            ? frame.bits(plane + 1) : frame.bits() + frame.mappedBytes();
+    return int(end - frame.bits(plane));
+}
+
+int planeRows(const QVideoFrame &frame, int plane)
+{
+    return planeBytes(frame, plane) / frame.bytesPerLine(plane);
+}
+
+} // namespace RQPlayer
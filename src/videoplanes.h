@@ -0,0 +1,35 @@
+/* videoplanes.h
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RQPLAYER_VIDEOPLANES_H
+#define RQPLAYER_VIDEOPLANES_H
+
+#include <QVideoFrame>
+
+namespace RQPlayer {
+
+// Geometry of a plane of a mapped frame, assuming the planes are stored
+// in order in one buffer (as in frames created by FramePool)
+int planeBytes(const QVideoFrame &frame, int plane);
+int planeRows(const QVideoFrame &frame, int plane);
+
+} // namespace RQPlayer
+
+#endif // RQPLAYER_VIDEOPLANES_H
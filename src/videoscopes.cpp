@@ -0,0 +1,306 @@
+/* videoscopes.cpp
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "videoscopes.h"
+
+#include <QMutexLocker>
+#include <QVector>
+#include <QDebug>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Rows sampled per frame, spread evenly over the frame height
+#define SCOPES_SAMPLED_ROWS     256
+// Width / height of the waveform and vectorscope images
+#define SCOPES_SIZE             256
+#define HISTOGRAM_HEIGHT        128
+
+namespace RQPlayer {
+
+namespace {
+
+// BT.601 limited range YUV to RGB coefficients, 6 bit fixed point
+const int CY = 75, CRV = 102, CGU = 25, CGV = 52, CBU = 129;
+
+inline uchar clampToByte(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+// Converts one row of 4:2:2 planar pixels into separate R, G and B rows
+void convertRow422ToRgb(const uchar *y, const uchar *u, const uchar *v,
+                        int width, uchar *r, uchar *g, uchar *b)
+{
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i off16 = _mm_set1_epi16(16);
+    const __m128i off128 = _mm_set1_epi16(128);
+    const __m128i cy = _mm_set1_epi16(CY);
+    const __m128i crv = _mm_set1_epi16(CRV);
+    const __m128i cgu = _mm_set1_epi16(CGU);
+    const __m128i cgv = _mm_set1_epi16(CGV);
+    const __m128i cbu = _mm_set1_epi16(CBU);
+    for (; x + 16 <= width; x += 16) {
+        const __m128i y8 = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(y + x));
+        __m128i u8 = _mm_loadl_epi64(
+                    reinterpret_cast<const __m128i *>(u + x / 2));
+        __m128i v8 = _mm_loadl_epi64(
+                    reinterpret_cast<const __m128i *>(v + x / 2));
+        u8 = _mm_unpacklo_epi8(u8, u8);
+        v8 = _mm_unpacklo_epi8(v8, v8);
+
+        __m128i rr[2], gg[2], bb[2];
+        for (int h = 0; h < 2; ++h) {
+            __m128i yy = h ? _mm_unpackhi_epi8(y8, zero)
+                           : _mm_unpacklo_epi8(y8, zero);
+            __m128i uu = h ? _mm_unpackhi_epi8(u8, zero)
+                           : _mm_unpacklo_epi8(u8, zero);
+            __m128i vv = h ? _mm_unpackhi_epi8(v8, zero)
+                           : _mm_unpacklo_epi8(v8, zero);
+            yy = _mm_mullo_epi16(_mm_sub_epi16(yy, off16), cy);
+            uu = _mm_sub_epi16(uu, off128);
+            vv = _mm_sub_epi16(vv, off128);
+            rr[h] = _mm_srai_epi16(
+                        _mm_adds_epi16(yy, _mm_mullo_epi16(vv, crv)), 6);
+            gg[h] = _mm_srai_epi16(
+                        _mm_subs_epi16(
+                            _mm_subs_epi16(yy, _mm_mullo_epi16(uu, cgu)),
+                            _mm_mullo_epi16(vv, cgv)), 6);
+            bb[h] = _mm_srai_epi16(
+                        _mm_adds_epi16(yy, _mm_mullo_epi16(uu, cbu)), 6);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(r + x),
+                         _mm_packus_epi16(rr[0], rr[1]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(g + x),
+                         _mm_packus_epi16(gg[0], gg[1]));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(b + x),
+                         _mm_packus_epi16(bb[0], bb[1]));
+    }
+#endif
+    for (; x < width; ++x) {
+        const int yy = (y[x] - 16) * CY;
+        const int uu = u[x / 2] - 128;
+        const int vv = v[x / 2] - 128;
+        r[x] = clampToByte((yy + CRV * vv) >> 6);
+        g[x] = clampToByte((yy - CGU * uu - CGV * vv) >> 6);
+        b[x] = clampToByte((yy + CBU * uu) >> 6);
+    }
+}
+
+// Accumulates into 4 interleaved sub-histograms (4 x 256 bins) so that
+// runs of equal values don't serialize on the same counter
+void accumulateHistogram(const uchar *data, int count, quint32 *hist)
+{
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        ++hist[data[i]];
+        ++hist[256 + data[i + 1]];
+        ++hist[512 + data[i + 2]];
+        ++hist[768 + data[i + 3]];
+    }
+    for (; i < count; ++i) {
+        ++hist[data[i]];
+    }
+}
+
+inline int logIntensity(quint32 count, double logMax)
+{
+    return count ? qMin(255, int(255 * std::log1p(count) / logMax)) : 0;
+}
+
+} // namespace
+
+VideoScopes::VideoScopes(QObject *parent)
+    : QThread(parent), m_stopRequested(false), m_enabled(false)
+{
+}
+
+VideoScopes::~VideoScopes()
+{
+}
+
+void VideoScopes::stop()
+{
+    m_stopRequested = true;
+    QMutexLocker lock(&m_frameMutex);
+    m_frameAvailable.wakeAll();
+}
+
+void VideoScopes::setEnabled(bool enabled)
+{
+    if (m_enabled != enabled) {
+        m_enabled = enabled;
+        emit enabledChanged(enabled);
+    }
+}
+
+QImage VideoScopes::scopeImage(Scope scope) const
+{
+    QMutexLocker lock(&m_imagesMutex);
+    return m_images[scope];
+}
+
+void VideoScopes::analyzeFrame(const QVideoFrame &frame)
+{
+    if (!m_enabled || !frame.isValid()) {
+        return;
+    }
+    QMutexLocker lock(&m_frameMutex);
+    if (m_pendingFrame.isValid() && ++m_skippedFrames % 250 == 0) {
+        qDebug() << "VideoScopes: skipped frames:" << m_skippedFrames;
+    }
+    m_pendingFrame = frame;
+    m_frameAvailable.wakeOne();
+}
+
+void VideoScopes::run()
+{
+    while (!m_stopRequested) {
+        QVideoFrame frame;
+        {
+            QMutexLocker lock(&m_frameMutex);
+            while (!m_pendingFrame.isValid() && !m_stopRequested) {
+                m_frameAvailable.wait(&m_frameMutex);
+            }
+            frame = m_pendingFrame;
+            m_pendingFrame = QVideoFrame();
+        }
+        if (frame.isValid()) {
+            analyze(frame);
+        }
+    }
+}
+
+void VideoScopes::analyze(QVideoFrame &frame)
+{
+    if (frame.pixelFormat() != QVideoFrame::Format_YUV422P
+            || !frame.map(QAbstractVideoBuffer::ReadOnly)) {
+        return;
+    }
+    if (frame.planeCount() < 3) {
+        frame.unmap();
+        return;
+    }
+    const int width = frame.width();
+    const int height = frame.height();
+    const int rowStep = qMax(1, height / SCOPES_SAMPLED_ROWS);
+
+    // Y, R, G and B histograms, each split in 4 sub-histograms
+    QVector<quint32> hist(4 * 4 * 256, 0);
+    QVector<quint32> wave(SCOPES_SIZE * 256, 0);
+    QVector<quint32> vector(256 * 256, 0);
+    QVector<int> column(width);
+    for (int x = 0; x < width; ++x) {
+        column[x] = x * SCOPES_SIZE / width * 256;
+    }
+    QByteArray rgb(width * 3, Qt::Uninitialized);
+    uchar *r = reinterpret_cast<uchar *>(rgb.data());
+    uchar *g = r + width;
+    uchar *b = g + width;
+
+    int sampledRows = 0;
+    for (int row = rowStep / 2; row < height; row += rowStep) {
+        const uchar *y = frame.bits(0) + row * frame.bytesPerLine(0);
+        const uchar *u = frame.bits(1) + row * frame.bytesPerLine(1);
+        const uchar *v = frame.bits(2) + row * frame.bytesPerLine(2);
+
+        convertRow422ToRgb(y, u, v, width, r, g, b);
+        accumulateHistogram(y, width, hist.data());
+        accumulateHistogram(r, width, hist.data() + 1024);
+        accumulateHistogram(g, width, hist.data() + 2048);
+        accumulateHistogram(b, width, hist.data() + 3072);
+
+        for (int x = 0; x < width; ++x) {
+            ++wave[column[x] + y[x]];
+        }
+        for (int x = 0; x < width / 2; ++x) {
+            ++vector[(255 - v[x]) * 256 + u[x]];
+        }
+        ++sampledRows;
+    }
+    frame.unmap();
+
+    quint32 bins[4][256];
+    quint32 maxBin = 1;
+    for (int c = 0; c < 4; ++c) {
+        const quint32 *h = hist.constData() + c * 1024;
+        for (int i = 0; i < 256; ++i) {
+            bins[c][i] = h[i] + h[256 + i] + h[512 + i] + h[768 + i];
+            maxBin = qMax(maxBin, bins[c][i]);
+        }
+    }
+
+    QImage histImage(256, HISTOGRAM_HEIGHT, QImage::Format_ARGB32);
+    for (int x = 0; x < 256; ++x) {
+        int levels[4];
+        for (int c = 0; c < 4; ++c) {
+            levels[c] = int(quint64(bins[c][x]) * HISTOGRAM_HEIGHT / maxBin);
+        }
+        for (int level = 0; level < HISTOGRAM_HEIGHT; ++level) {
+            const bool on[4] = {levels[0] > level, levels[1] > level,
+                                levels[2] > level, levels[3] > level};
+            const int base = on[0] ? 55 : 0;
+            histImage.setPixel(x, HISTOGRAM_HEIGHT - 1 - level, qRgba(
+                    base + (on[1] ? 200 : 0), base + (on[2] ? 200 : 0),
+                    base + (on[3] ? 200 : 0),
+                    (on[0] || on[1] || on[2] || on[3]) ? 220 : 120));
+        }
+    }
+
+    const double waveLogMax = std::log1p(
+                qMax(1, sampledRows * width / SCOPES_SIZE));
+    QImage waveImage(SCOPES_SIZE, 256, QImage::Format_ARGB32);
+    for (int level = 0; level < 256; ++level) {
+        QRgb *line = reinterpret_cast<QRgb *>(waveImage.scanLine(255 - level));
+        for (int c = 0; c < SCOPES_SIZE; ++c) {
+            const int i = logIntensity(wave[c * 256 + level], waveLogMax);
+            line[c] = qRgba(i / 3, i, i / 3, qMax(120, i));
+        }
+    }
+
+    quint32 maxVector = 1;
+    for (quint32 count : vector) {
+        maxVector = qMax(maxVector, count);
+    }
+    const double vectorLogMax = std::log1p(maxVector);
+    QImage vectorImage(256, 256, QImage::Format_ARGB32);
+    for (int row = 0; row < 256; ++row) {
+        QRgb *line = reinterpret_cast<QRgb *>(vectorImage.scanLine(row));
+        for (int col = 0; col < 256; ++col) {
+            const int i = logIntensity(vector[row * 256 + col], vectorLogMax);
+            line[col] = qRgba(i / 3, i, i / 3, qMax(120, i));
+        }
+    }
+
+    {
+        QMutexLocker lock(&m_imagesMutex);
+        m_images[Histogram] = histImage;
+        m_images[Waveform] = waveImage;
+        m_images[Vectorscope] = vectorImage;
+    }
+    emit scopesUpdated();
+}
+
+} // namespace RQPlayer
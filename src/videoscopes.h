@@ -0,0 +1,91 @@
+/* videoscopes.h
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RQPLAYER_VIDEOSCOPES_H
+#define RQPLAYER_VIDEOSCOPES_H
+
+#include <QThread>
+#include <QVideoFrame>
+#include <QImage>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInteger>
+
+namespace RQPlayer {
+
+// Computes histogram, waveform and vectorscope images from the frames
+// being presented. Runs on its own thread and only ever keeps the latest
+// frame, so frames are skipped rather than slowing down playback when
+// analysis can't keep up.
+class VideoScopes : public QThread
+{
+    Q_OBJECT
+
+    Q_PROPERTY(bool enabled
+               READ isEnabled
+               WRITE setEnabled
+               NOTIFY enabledChanged)
+
+public:
+    enum Scope {
+        Histogram,
+        Waveform,
+        Vectorscope
+    };
+    Q_ENUM(Scope)
+
+    explicit VideoScopes(QObject *parent = nullptr);
+    ~VideoScopes();
+
+    void stop();
+
+    bool isEnabled() const { return m_enabled; }
+    void setEnabled(bool enabled);
+
+    QImage scopeImage(Scope scope) const;
+
+public slots:
+    void analyzeFrame(const QVideoFrame &frame);
+
+signals:
+    void enabledChanged(bool enabled);
+    void scopesUpdated();
+
+protected:
+    void run() override;
+
+private:
+    void analyze(QVideoFrame &frame);
+
+    QAtomicInteger<bool> m_stopRequested;
+    QAtomicInteger<bool> m_enabled;
+
+    QVideoFrame m_pendingFrame;
+    quint64 m_skippedFrames = 0;
+    QMutex m_frameMutex;
+    QWaitCondition m_frameAvailable;
+
+    mutable QMutex m_imagesMutex;
+    QImage m_images[3];
+};
+
+} // namespace RQPlayer
+
+#endif // RQPLAYER_VIDEOSCOPES_H
@@ -0,0 +1,168 @@
+/* rqpack.cpp
+ *
+ * Copyright (C) 2022 Siddharudh P T <siddharudh@gmail.com>
+ *
+ * This file is part of RQPlayer.
+ *
+ * RQPlayer is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * RQPlayer is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with RQPlayer.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Packs raw video frames into an RQZ file (see rqzformat.h)
+//
+//   rqpack [-a acceleration] <WxH | frame-bytes> <input | -> <output.rqz>
+//
+// WxH assumes YUV 4:2:2 planar frames, as played by RQPlayer.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+#include <lz4.h>
+
+#include "rqzformat.h"
+
+namespace {
+
+void writeU32(std::vector<char> &out, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(char((value >> (8 * i)) & 0xFF));
+    }
+}
+
+void writeU64(std::vector<char> &out, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(char((value >> (8 * i)) & 0xFF));
+    }
+}
+
+bool writeAll(FILE *fp, const std::vector<char> &data)
+{
+    return data.empty() || fwrite(data.data(), data.size(), 1, fp) == 1;
+}
+
+int usage()
+{
+    fprintf(stderr, "Usage: rqpack [-a acceleration] <WxH | frame-bytes> "
+                    "<input | -> <output.rqz>\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    int acceleration = 1;
+    int arg = 1;
+    if (arg + 1 < argc && strcmp(argv[arg], "-a") == 0) {
+        acceleration = atoi(argv[arg + 1]);
+        arg += 2;
+    }
+    if (argc - arg != 3) {
+        return usage();
+    }
+
+    long frameBytes = 0;
+    int width = 0, height = 0;
+    if (sscanf(argv[arg], "%dx%d", &width, &height) == 2) {
+        frameBytes = long(width) * height * 2;
+    }
+    else {
+        frameBytes = atol(argv[arg]);
+    }
+    if (frameBytes <= 0 || frameBytes > LZ4_MAX_INPUT_SIZE) {
+        fprintf(stderr, "rqpack: invalid frame size: %s\n", argv[arg]);
+        return 2;
+    }
+
+    FILE *in = strcmp(argv[arg + 1], "-") == 0
+            ? stdin : fopen(argv[arg + 1], "rb");
+    if (!in) {
+        perror(argv[arg + 1]);
+        return 1;
+    }
+    FILE *out = fopen(argv[arg + 2], "wb");
+    if (!out) {
+        perror(argv[arg + 2]);
+        return 1;
+    }
+
+    std::vector<char> header(RQZ_MAGIC, RQZ_MAGIC + RQZ_MAGIC_SIZE);
+    writeU32(header, uint32_t(frameBytes));
+    writeU32(header, 0);    // frame count, updated at the end
+    if (!writeAll(out, header)) {
+        perror(argv[arg + 2]);
+        return 1;
+    }
+
+    std::vector<char> frame(static_cast<size_t>(frameBytes));
+    std::vector<char> block(static_cast<size_t>(
+            LZ4_compressBound(int(frameBytes))));
+    std::vector<uint64_t> offsets;
+    uint64_t offset = RQZ_HEADER_SIZE;
+    uint64_t compressedBytes = 0;
+    while (fread(frame.data(), frame.size(), 1, in) == 1) {
+        int size = LZ4_compress_fast(frame.data(), block.data(),
+                                     int(frameBytes), int(block.size()),
+                                     acceleration);
+        const bool stored = size <= 0 || size >= frameBytes;
+        const char *data = stored ? frame.data() : block.data();
+        if (stored) {
+            size = int(frameBytes);
+        }
+        std::vector<char> blockHeader;
+        writeU32(blockHeader, uint32_t(size) | (stored ? RQZ_STORED_FLAG : 0));
+        if (!writeAll(out, blockHeader)
+                || fwrite(data, size_t(size), 1, out) != 1) {
+            perror(argv[arg + 2]);
+            return 1;
+        }
+        offsets.push_back(offset);
+        offset += 4 + uint64_t(size);
+        compressedBytes += uint64_t(size);
+    }
+
+    std::vector<char> trailer;
+    writeU32(trailer, 0);   // end of frames
+    const uint64_t indexOffset = offset + 4;
+    for (uint64_t frameOffset : offsets) {
+        writeU64(trailer, frameOffset);
+    }
+    writeU64(trailer, indexOffset);
+    trailer.insert(trailer.end(), RQZ_INDEX_MAGIC,
+                   RQZ_INDEX_MAGIC + RQZ_MAGIC_SIZE);
+    if (!writeAll(out, trailer)) {
+        perror(argv[arg + 2]);
+        return 1;
+    }
+
+    std::vector<char> frameCount;
+    writeU32(frameCount, uint32_t(offsets.size()));
+    if (fseek(out, RQZ_HEADER_SIZE - 4, SEEK_SET) == 0) {
+        writeAll(out, frameCount);
+    }
+    fclose(out);
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    const double rawBytes = double(frameBytes) * offsets.size();
+    fprintf(stderr, "rqpack: %zu frames, %.1f%% of raw size\n",
+            offsets.size(),
+            rawBytes > 0 ? 100.0 * compressedBytes / rawBytes : 0.0);
+    return 0;
+}
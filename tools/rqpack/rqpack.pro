@@ -0,0 +1,15 @@
+TEMPLATE = app
+TARGET = rqpack
+
+CONFIG += console c++11 link_pkgconfig
+CONFIG -= app_bundle qt
+
+PKGCONFIG += liblz4
+
+INCLUDEPATH += ../../src
+
+SOURCES += \
+        rqpack.cpp
+
+HEADERS += \
+    ../../src/rqzformat.h